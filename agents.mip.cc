@@ -1,6 +1,19 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-#include <unordered_map>
+#include <map>
+#include <sstream>
+#include <sys/resource.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 #include "easyscip/easyscip.h"
+#include "easyscip/cache.h"
+#include "easyscip/reader.h"
 
 using namespace std;
 using namespace easyscip;
@@ -24,330 +37,2201 @@ struct Visit {
         : relative_index(relative_index), slot(slot), pool_size(pool_size), x(x), y(y) {};
 };
 
+// All visits, one array per field, so the hot loops (distances, slot scans)
+// only read the fields they use
+struct Visits {
+    vector<int> relative_index, slot, pool_size;
+    vector<double> x, y;
+
+    int size() const { return slot.size(); }
+    void reserve(int n) {
+        relative_index.reserve(n);
+        slot.reserve(n);
+        pool_size.reserve(n);
+        x.reserve(n);
+        y.reserve(n);
+    }
+    void push_back(const Visit& v) {
+        relative_index.push_back(v.relative_index);
+        slot.push_back(v.slot);
+        pool_size.push_back(v.pool_size);
+        x.push_back(v.x);
+        y.push_back(v.y);
+    }
+    Visit at(int v) const { return Visit(relative_index[v], slot[v], pool_size[v], x[v], y[v]); }
+};
+
 double distance(double x0, double y0, double x1, double y1) {
     return sqrt((x0 - x1) * (x0 - x1) + (y0 - y1) * (y0 - y1));
 }
 
-void printData(vector<Agent> agents, vector<Visit> visits) {
+// Distances from (x, y) to the points (xs[i], ys[i]) of a structure of arrays, into out[0 .. n)
+// sqrt sets errno, so the compiler won't vectorize the plain loop; the x86-64 versions do it by hand,
+// four at a time with AVX (when the CPU has it) or two at a time with SSE2 (every x86-64 has it).
+// Same operations in the same order as distance(), so both give the same values to the last bit.
+void distancesScalar(double x, double y, const double *xs, const double *ys, int n, double *out) {
+    for (int i = 0; i < n; ++i) {
+        out[i] = distance(x, y, xs[i], ys[i]);
+    }
+}
+
+#ifdef __x86_64__
+void distancesSSE2(double x, double y, const double *xs, const double *ys, int n, double *out) {
+    __m128d px = _mm_set1_pd(x), py = _mm_set1_pd(y);
     int i = 0;
-    cout << "::::: Data read from file: " << endl << endl;
+    for (; i + 2 <= n; i += 2) {
+        __m128d ddx = _mm_sub_pd(px, _mm_loadu_pd(xs + i));
+        __m128d ddy = _mm_sub_pd(py, _mm_loadu_pd(ys + i));
+        _mm_storeu_pd(out + i, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(ddx, ddx), _mm_mul_pd(ddy, ddy))));
+    }
+    distancesScalar(x, y, xs + i, ys + i, n - i, out + i);
+}
 
-    for (Agent a : agents) {
-        cout << "Agent " << i++ << ", relative_index: " << a.relative_index << " x: " << a.x << " y: " << a.y << endl;
+__attribute__((target("avx")))
+void distancesAVX(double x, double y, const double *xs, const double *ys, int n, double *out) {
+    __m256d px = _mm256_set1_pd(x), py = _mm256_set1_pd(y);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d ddx = _mm256_sub_pd(px, _mm256_loadu_pd(xs + i));
+        __m256d ddy = _mm256_sub_pd(py, _mm256_loadu_pd(ys + i));
+        _mm256_storeu_pd(out + i, _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(ddx, ddx), _mm256_mul_pd(ddy, ddy))));
     }
+    distancesScalar(x, y, xs + i, ys + i, n - i, out + i);
+}
+#endif
 
-    i = 0;
-    cout << endl;
-    for (Visit v : visits) {
-        cout << "Visit " << i++ << ", relative_index: " << v.relative_index << " slot: " << v.slot << " x: " << v.x << " y: " << v.y << " pool_size: " << v.pool_size << endl;
+void distances(double x, double y, const double *xs, const double *ys, int n, double *out) {
+#ifdef __x86_64__
+    static const bool avx = __builtin_cpu_supports("avx");
+    if (avx) {
+        distancesAVX(x, y, xs, ys, n, out);
+    } else {
+        distancesSSE2(x, y, xs, ys, n, out);
     }
+#else
+    distancesScalar(x, y, xs, ys, n, out);
+#endif
+}
 
-    cout << endl;
+// Visits sorted by slot, with prefix offsets for every distinct slot
+// visits of the s-th slot are [slotStart[s], slotStart[s+1]) and slotOf[v] = s
+struct SlotIndex {
+    vector<int> slotStart;
+    vector<int> slotOf;
+
+    int size() const { return slotStart.size() - 1; }
+};
+
+// Visit-to-visit arcs shared by all agents, in CSR form
+// arcs leaving visit v are [outStart[v], outStart[v+1]) (arc ids are sorted by origin)
+// arcs arriving at visit v are inArcs[inStart[v] .. inStart[v+1])
+struct ArcStore {
+    vector<int> origin, destination;
+    vector<double> cost;
+    vector<int> outStart, inStart, inArcs;
+
+    int size() const { return origin.size(); }
+};
+
+// Variables of a single agent, only for arcs that exist
+struct AgentArcs {
+    vector<Variable> leave; // house -> visit, indexed by visit
+    vector<Variable> back;  // visit -> house, indexed by visit
+    vector<Variable> move;  // visit -> visit, indexed by arc id
+};
+
+enum ArcKind { LEAVE, BACK, MOVE };
+
+// MIP model: visit-to-visit arcs per agent, or shared by all agents as one flow (see buildFlowModel),
+// or whole routes generated as they are needed (see buildRouteMaster)
+enum Formulation { AGENT_FORMULATION, FLOW_FORMULATION, ROUTE_FORMULATION };
+
+// A run of consecutive variables of the same agent and kind, so the arc of a
+// variable can be told from its index without a lookup table per variable
+//     variable first + k is leave/back of visit base + k, or move of arc base + k
+// (agent is -1 for the shared arcs of the flow formulation)
+struct VarBlock {
+    int first, count;
+    int agent;
+    ArcKind kind;
+    int base;
+};
+
+// Route formulation: the route of a column, its visits in slot order (never empty)
+struct RouteColumn {
+    int agent;
+    vector<int> visits;
+};
+
+// Route formulation: a branching decision on an arc, "used" or "not used"
+//     LEAVE / BACK: between the house of agent and visit at
+//     MOVE:         arc id at (agent is -1)
+struct ArcDecision {
+    ArcKind kind;
+    int agent, at;
+    bool used;
+};
+
+// Everything built for the MIP, kept so the model can grow or shrink between solves
+// (rows are only valid when the solver keeps them, see --incremental)
+struct Model {
+    vector<Agent> agents;
+    Visits visits;
+    vector<bool> cancelled;
+    SlotIndex slots;       // only covers the visits read at start
+    vector<double> house;  // house[a * visits + v] = distance between the house of agent a and visit v,
+                           // only covers the visits read at start
+    ArcStore arcs;         // CSR offsets only cover the visits read at start
+    vector<vector<int>> addedOut, addedIn; // arcs created later, by visit
+    vector<AgentArcs> va;
+    vector<VarBlock> blocks;
+    vector<Variable> flow;  // flow formulation only: shared visit-to-visit arcs, by arc id
+    vector<Variable> label; // flow formulation only: agent doing each visit
+    vector<RouteColumn> columns; // route formulation only: the route of every column
+    vector<Variable> columnVars; // and its variable, variable firstColumn + k for column k
+    int firstColumn;
+
+    vector<Row> visitRows;              // at most one agent per visit
+    vector<vector<Row>> continuityRows; // [agent][visit]
+    map<int, Row> slotRows;             // by slot value
+    map<int, int> slotVisits;           // visits not cancelled, by slot value
+    Row coverageRow;
+    int totalNumVisitors;
+    vector<Row> startRows, endRows;
+};
+
+// Routes chosen in a solution
+// first[a] = first visit of agent a (-1 -> he never left home)
+// next[v] = visit done right after v by the same agent (-1 -> he went back home)
+struct Routes {
+    vector<int> first, next;
+};
+
+// Records vars[from ..] as a block of the model
+void addBlock(Model& model, int agent, ArcKind kind, int base, const vector<Variable>& vars, int from) {
+    if (from < (int) vars.size()) {
+        VarBlock block = { vars[from].index(), (int) vars.size() - from, agent, kind, base };
+        model.blocks.push_back(block);
+    }
 }
 
-void printHashTable(unordered_map<int, vector<Visit>> visitsBySlot) {
-    cout << "::::: Visits by slot map: " << endl << endl;
+// Only the chosen arcs are looked at, all values come from a single call to SCIP
+// The same decoding serves the flow formulation: a route starts at the visit its agent leaves to
+// and follows the only arc used out of every visit, shared arcs don't need to know the agent
+Routes readRoutes(const Solution& sol, const Model& model) {
+    Routes routes;
+    routes.first.assign(model.agents.size(), -1);
+    routes.next.assign(model.visits.size(), -1);
 
-    for (auto visitSlot : visitsBySlot) {
-        cout << "Slot: " << visitSlot.first << endl;
-        for (Visit v : visitSlot.second) {
-            cout << "Visit relative_index: " << v.relative_index << " slot: " << v.slot << " x: " << v.x << " y: " << v.y << " pool_size: " << v.pool_size << endl;
+    // route formulation, every chosen column is a whole route
+    if (!model.columns.empty()) {
+        for (Variable var : sol.values().nonzeros()) {
+            int k = var.index() - model.firstColumn;
+            if (k < 0 || k >= (int) model.columns.size()) {
+                continue;
+            }
+            const RouteColumn& column = model.columns[k];
+            routes.first[column.agent] = column.visits[0];
+            for (int i = 0; i + 1 < (int) column.visits.size(); ++i) {
+                routes.next[column.visits[i]] = column.visits[i + 1];
+            }
         }
+        return routes;
     }
 
-    cout << endl;
+    for (Variable var : sol.values().nonzeros()) {
+        auto block = upper_bound(model.blocks.begin(), model.blocks.end(), var.index(),
+                                 [](int index, const VarBlock& b) { return index < b.first; });
+        if (block == model.blocks.begin()) {
+            continue;
+        }
+        --block;
+        if (var.index() >= block->first + block->count) {
+            continue; // not an arc (a label of the flow formulation)
+        }
+        int k = block->base + var.index() - block->first;
+        if (block->kind == LEAVE) {
+            routes.first[block->agent] = k;
+        } else if (block->kind == MOVE) {
+            routes.next[model.arcs.origin[k]] = model.arcs.destination[k];
+        }
+    }
+
+    return routes;
 }
 
-int main() {
-    int index = 0;
-    int numAgents;
-    int numVisits;
-    double x, y;
-    int slot, pool_size;
+// Arc id from visit o to visit d in the store, -1 if there is none
+// (arcs leaving a visit are sorted by destination)
+int findArc(const ArcStore& arcs, int o, int d) {
+    if (o + 1 >= (int) arcs.outStart.size()) {
+        return -1;
+    }
+    auto begin = arcs.destination.begin() + arcs.outStart[o];
+    auto end = arcs.destination.begin() + arcs.outStart[o + 1];
+    auto it = lower_bound(begin, end, d);
+    return it != end && *it == d ? it - arcs.destination.begin() : -1;
+}
 
-    unordered_map<int, vector<Visit>> visitsBySlot;
+// Same, also looking at the arcs added in incremental mode
+int findArc(const Model& model, int o, int d) {
+    int e = findArc(model.arcs, o, d);
+    if (e >= 0) {
+        return e;
+    }
+    for (int e : model.addedOut[o]) {
+        if (model.arcs.destination[e] == d) {
+            return e;
+        }
+    }
+    return -1;
+}
 
-    cin >> numAgents;
-    vector<Agent> agents;
-    agents.reserve(numAgents);
+// Sorts visits by slot (keeping input order inside a slot) and builds the offsets
+SlotIndex buildSlotIndex(Visits& visits) {
+    vector<int> order(visits.size());
+    for (int v = 0; v < (int) order.size(); ++v) {
+        order[v] = v;
+    }
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return visits.slot[a] < visits.slot[b]; });
+    Visits sorted;
+    sorted.reserve(visits.size());
+    for (int v : order) {
+        sorted.push_back(visits.at(v));
+    }
+    swap(visits, sorted);
 
-    for (int i = 0; i < numAgents; ++i) {
-        cin >> x >> y;
-        agents.push_back(Agent(index++, x, y));
+    SlotIndex slots;
+    slots.slotOf.reserve(visits.size());
+    for (int v = 0; v < (int) visits.size(); ++v) {
+        if (v == 0 || visits.slot[v] != visits.slot[v - 1]) {
+            slots.slotStart.push_back(v);
+        }
+        slots.slotOf.push_back(slots.slotStart.size() - 1);
     }
+    slots.slotStart.push_back(visits.size());
 
-    cin >> numVisits;
-    vector<Visit> visits;
-    visits.reserve(numVisits);
+    return slots;
+}
 
-    for (int i = 0; i < numVisits; ++i) {
-        cin >> slot >> x >> y >> pool_size;
-        Visit v = Visit(index++, slot, pool_size, x, y);
+// With visits sorted by slot the arcs leaving v go to every visit from the next slot on,
+// and the arcs arriving at d come from every visit before d's slot, so no pair has to be tested
+ArcStore buildArcStore(const Visits& visits, const SlotIndex& slots) {
+    int numVisits = visits.size();
+    ArcStore arcs;
+    arcs.outStart.assign(numVisits + 1, 0);
+    arcs.inStart.assign(numVisits + 1, 0);
 
-        visits.push_back(v);
+    for (int o = 0; o < numVisits; ++o) {
+        arcs.outStart[o + 1] = arcs.outStart[o] + numVisits - slots.slotStart[slots.slotOf[o] + 1];
+    }
+    arcs.origin.resize(arcs.outStart[numVisits]);
+    arcs.destination.resize(arcs.outStart[numVisits]);
+    arcs.cost.resize(arcs.outStart[numVisits]);
+    for (int o = 0; o < numVisits; ++o) {
+        int first = slots.slotStart[slots.slotOf[o] + 1];
+        for (int e = arcs.outStart[o]; e < arcs.outStart[o + 1]; ++e) {
+            arcs.origin[e] = o;
+            arcs.destination[e] = first + e - arcs.outStart[o];
+        }
+        distances(visits.x[o], visits.y[o], visits.x.data() + first, visits.y.data() + first, numVisits - first,
+                  arcs.cost.data() + arcs.outStart[o]);
+    }
 
-        // Build visits by slot map helper
-        auto exists = visitsBySlot.find(v.slot);
-        if (exists == visitsBySlot.end()) {
-            visitsBySlot.insert({ v.slot, vector<Visit>{v} });
-        } else {
-            exists->second.push_back(v);
+    arcs.inArcs.reserve(arcs.size());
+    for (int d = 0; d < numVisits; ++d) {
+        arcs.inStart[d] = arcs.inArcs.size();
+        int firstOfSlot = slots.slotStart[slots.slotOf[d]];
+        for (int o = 0; o < firstOfSlot; ++o) {
+            arcs.inArcs.push_back(arcs.outStart[o] + d - slots.slotStart[slots.slotOf[o] + 1]);
         }
     }
+    arcs.inStart[numVisits] = arcs.inArcs.size();
 
-    if(DEBUG) { printData(agents, visits); }
+    return arcs;
+}
+
+// Uniform grid over some visits (about 2 per cell), to find the ones close to a point
+// without looking at all of them; the visits of a cell are items[cellStart[c] .. cellStart[c+1])
+struct Grid {
+    double minX, minY, cellSize;
+    int cols, rows;
+    vector<int> cellStart, items;
+
+    int col(double x) const { return max(0, min(cols - 1, (int) ((x - minX) / cellSize))); }
+    int row(double y) const { return max(0, min(rows - 1, (int) ((y - minY) / cellSize))); }
+};
+
+// Grid over visits [begin, end)
+Grid buildGrid(const Visits& visits, int begin, int end) {
+    Grid grid;
+    double maxX = visits.x[begin], maxY = visits.y[begin];
+    grid.minX = maxX;
+    grid.minY = maxY;
+    for (int v = begin; v < end; ++v) {
+        grid.minX = min(grid.minX, visits.x[v]);
+        grid.minY = min(grid.minY, visits.y[v]);
+        maxX = max(maxX, visits.x[v]);
+        maxY = max(maxY, visits.y[v]);
+    }
+    double area = max(maxX - grid.minX, 1e-9) * max(maxY - grid.minY, 1e-9);
+    grid.cellSize = max(sqrt(2 * area / (end - begin)), 1e-9);
+    grid.cellSize = max(grid.cellSize, max(maxX - grid.minX, maxY - grid.minY) / 4000); // at most 4000 x 4000 cells
+    grid.cols = (int) ((maxX - grid.minX) / grid.cellSize) + 1;
+    grid.rows = (int) ((maxY - grid.minY) / grid.cellSize) + 1;
+
+    // counting sort of the visits by cell
+    grid.cellStart.assign(grid.cols * grid.rows + 1, 0);
+    for (int v = begin; v < end; ++v) {
+        grid.cellStart[grid.row(visits.y[v]) * grid.cols + grid.col(visits.x[v]) + 1]++;
+    }
+    for (int c = 0; c < grid.cols * grid.rows; ++c) {
+        grid.cellStart[c + 1] += grid.cellStart[c];
+    }
+    vector<int> fill(grid.cellStart.begin(), grid.cellStart.end() - 1);
+    grid.items.resize(end - begin);
+    for (int v = begin; v < end; ++v) {
+        grid.items[fill[grid.row(visits.y[v]) * grid.cols + grid.col(visits.x[v])]++] = v;
+    }
+
+    return grid;
+}
 
-    if(DEBUG) { printHashTable(visitsBySlot); }
+// Visits of the grid that are among the k nearest to (x, y) or closer than radius (0 turns each rule off)
+// are appended to kept. The grid is searched in rings around the point: ring r only has visits
+// farther than (r - 1) * cellSize, so the search stops as soon as k visits closer than that
+// are known and no visit is left within radius.
+void closeVisits(const Grid& grid, const Visits& visits, double x, double y, int k, double radius,
+                 vector<pair<double, int>>& heap, vector<int>& kept) {
+    int cx = grid.col(x), cy = grid.row(y);
+    heap.clear(); // (distance, visit), a max-heap on distance for the k nearest
 
-    MIPSolver mip;
+    for (int r = 0; r <= grid.cols || r <= grid.rows; ++r) {
+        double ringDistance = (r - 1) * grid.cellSize;
+        bool needNearest = k > 0 && ((int) heap.size() < k || heap.front().first > ringDistance);
+        bool needRadius = radius > 0 && ringDistance <= radius;
+        if (!needNearest && !needRadius) {
+            break;
+        }
+        for (int j = cy - r; j <= cy + r; ++j) {
+            for (int i = cx - r; i <= cx + r; ++i) {
+                if (j < 0 || j >= grid.rows || i < 0 || i >= grid.cols ||
+                    (j != cy - r && j != cy + r && i != cx - r && i != cx + r)) {
+                    continue;
+                }
+                int c = j * grid.cols + i;
+                for (int k2 = grid.cellStart[c]; k2 < grid.cellStart[c + 1]; ++k2) {
+                    int d = grid.items[k2];
+                    double dist = distance(x, y, visits.x[d], visits.y[d]);
+                    if (radius > 0 && dist <= radius) {
+                        kept.push_back(d);
+                    } else if (k > 0 && ((int) heap.size() < k || dist < heap.front().first)) {
+                        heap.push_back(make_pair(dist, d));
+                        push_heap(heap.begin(), heap.end());
+                        if ((int) heap.size() > k) {
+                            pop_heap(heap.begin(), heap.end());
+                            heap.pop_back();
+                        }
+                    }
+                }
+            }
+        }
+    }
 
-    // 3d solver va[a][o][d] = binary variable which means "Agent a goes from Origin o to Destination d"
-    // can be used for visits and agents houses so
-    // va[a1][h1][v1] = "Agent a1 went from house1 to visit1"
-    // va[a1][v1][v2] = "Agent a1 went from visit1 to visit2"
-    // va[a1][v2][h1] = "Agent a1 went from visit2 to house1"
-    // etc ...
-    // Keep in min:
-    //     if we have 2 agents then:
-    //        va[-][-][0] and va[-][-][1] -> destinations are the agents houses
-    //        va[-][-][2] -> destination is first visit
-    //     this means the first values will represent agents houses (both in origin and destination)
-    //     so we will use "relative_index" from our objects to deal with that
+    for (auto close : heap) {
+        kept.push_back(close.second);
+    }
+}
 
-    int totalNumPlaces = numAgents + numVisits; // numAgents == number of agents houses
-    vector<vector<vector<Variable>>> va(numAgents, vector<vector<Variable>>(totalNumPlaces));
+// Only keeps, for every visit and every later slot, the arcs to the k nearest visits of that slot
+// and the ones shorter than radius. The slot restrictions ask for about every agent to be busy
+// in every slot, so each slot needs its own close successors.
+// The arcs of a feasible schedule (witness) are always kept, so the pruned model stays feasible.
+ArcStore buildPrunedArcStore(const Visits& visits, const SlotIndex& slots, int k, double radius, const Routes& witness) {
+    int numVisits = visits.size();
+    vector<Grid> grids;
+    for (int s = 0; s < slots.size(); ++s) {
+        grids.push_back(buildGrid(visits, slots.slotStart[s], slots.slotStart[s + 1]));
+    }
+    ArcStore arcs;
+    arcs.outStart.assign(numVisits + 1, 0);
 
-    // reserve our 3 dimension
-    for (int i = 0; i < numAgents; ++i) {
-        for (int j = 0; j < totalNumPlaces; ++j) {
-            va[i][j].reserve(totalNumPlaces);
+    vector<pair<double, int>> heap;
+    vector<int> kept;
+    for (int o = 0; o < numVisits; ++o) {
+        arcs.outStart[o] = arcs.size();
+        kept.clear();
+        for (int s = slots.slotOf[o] + 1; s < slots.size(); ++s) {
+            closeVisits(grids[s], visits, visits.x[o], visits.y[o], k, radius, heap, kept);
+        }
+        if (witness.next[o] >= 0) {
+            kept.push_back(witness.next[o]);
         }
+        sort(kept.begin(), kept.end());
+        kept.erase(unique(kept.begin(), kept.end()), kept.end());
+        for (int d : kept) {
+            arcs.origin.push_back(o);
+            arcs.destination.push_back(d);
+            arcs.cost.push_back(distance(visits.x[o], visits.y[o], visits.x[d], visits.y[d]));
+        }
+    }
+    arcs.outStart[numVisits] = arcs.size();
+
+    // counting sort of the arcs by destination
+    arcs.inStart.assign(numVisits + 1, 0);
+    for (int e = 0; e < arcs.size(); ++e) {
+        arcs.inStart[arcs.destination[e] + 1]++;
+    }
+    for (int d = 0; d < numVisits; ++d) {
+        arcs.inStart[d + 1] += arcs.inStart[d];
     }
+    vector<int> fill(arcs.inStart.begin(), arcs.inStart.end() - 1);
+    arcs.inArcs.resize(arcs.size());
+    for (int e = 0; e < arcs.size(); ++e) {
+        arcs.inArcs[fill[arcs.destination[e]]++] = e;
+    }
+
+    return arcs;
+}
+
+void printData(const vector<Agent>& agents, const Visits& visits) {
+    int i = 0;
+    cout << "::::: Data read from file: " << endl << endl;
 
     for (Agent a : agents) {
-        int agent = a.relative_index;
+        cout << "Agent " << i++ << ", relative_index: " << a.relative_index << " x: " << a.x << " y: " << a.y << endl;
+    }
 
-        // first for origin = houses
-        for (Agent h : agents) {
-            int origin = h.relative_index;
-            for (Visit vd : visits) {
-                int destination = vd.relative_index;
-                if (agent != origin) { // agent always has to start from his house, if it's different then -> null
-                    va[agent][origin][destination] = NullVariable();
-                } else {
-                    va[agent][origin][destination] = mip.binary_variable(distance(h.x, h.y, vd.x, vd.y));
-                }
-            }
+    i = 0;
+    cout << endl;
+    for (int k = 0; k < visits.size(); ++k) {
+        Visit v = visits.at(k);
+        cout << "Visit " << i++ << ", relative_index: " << v.relative_index << " slot: " << v.slot << " x: " << v.x << " y: " << v.y << " pool_size: " << v.pool_size << endl;
+    }
+
+    cout << endl;
+}
+
+void printSlots(const Visits& visits, const SlotIndex& slots) {
+    cout << "::::: Visits by slot: " << endl << endl;
+
+    for (int s = 0; s < slots.size(); ++s) {
+        cout << "Slot: " << visits.slot[slots.slotStart[s]] << endl;
+        for (int k = slots.slotStart[s]; k < slots.slotStart[s + 1]; ++k) {
+            Visit v = visits.at(k);
+            cout << "Visit relative_index: " << v.relative_index << " slot: " << v.slot << " x: " << v.x << " y: " << v.y << " pool_size: " << v.pool_size << endl;
         }
+    }
 
-        // for destination = house
-        for (Agent h : agents) {
-            int destination = h.relative_index;
-            for (Visit vo : visits) {
-                int origin = vo.relative_index;
-                if (agent != destination) { // agent always has to end at his house, if it's different then -> null
-                    va[agent][origin][destination] = NullVariable();
-                } else {
-                    va[agent][origin][destination] = mip.binary_variable(distance(vo.x, vo.y, h.x, h.y));
-                }
+    cout << endl;
+}
+
+void printRoutes(const Model& model, const Routes& routes) {
+    const Visits& visits = model.visits;
+    int numAgents = model.agents.size();
+
+    cout << endl;
+    for (int agent = 0; agent < numAgents; ++agent) {
+        cout << "Agent " << agent << " (House " << agent << ")" << endl;
+        int v = routes.first[agent];
+        if (v >= 0) {
+            cout << "Went from House " << agent << " to Visit " << visits.relative_index[v] - numAgents << endl;
+            while (routes.next[v] >= 0) {
+                cout << "Went from Visit " << visits.relative_index[v] - numAgents << " to Visit " << visits.relative_index[routes.next[v]] - numAgents << endl;
+                v = routes.next[v];
             }
+            cout << "Went from Visit " << visits.relative_index[v] - numAgents << " to House " << agent << endl;
         }
+        cout << endl;
+    }
+}
+
+// Restriction considering number of visits on each slot (cant be more than number of available agents)
+// At most cant be more than the number of agents so <= numAgents
+// At mininum it's min(totalVisitsInSlot, numAgents) because:
+//    - if in slot we have more visits than the number of agents,
+//      then the minimum visits that happen is the number of agents (7 visits, 5 agents -> 5 visits happen)
+//    - if in slot we have less visits than the number of agents,
+//      then the minimum visits that happen is the number of visits (3 visits, 5 agents -> 3 visits happen)
+double slotLowerBound(const Model& model, int slot) {
+    return min(model.slotVisits.at(slot), (int) model.agents.size());
+}
+
+// Restriction because we can only have less than 5% visits "canceled"
+//     -> that will have no arc arriving at them
+// here I describe it the oposite way, if only less than 5% can be canceled
+// then we know the ones that will happen are between 95% and 100%
+int numVisitors95(const Model& model) {
+    return model.totalNumVisitors * 0.95;
+}
 
-        // between visits
-        for (Visit vo : visits) {
-            int origin = vo.relative_index;
-            for (Visit vd : visits) {
-                int destination = vd.relative_index;
+void buildModel(MIPSolver& mip, Model& model) {
+    const vector<Agent>& agents = model.agents;
+    const Visits& visits = model.visits;
+    int numAgents = agents.size();
+    int numVisits = visits.size();
+    const SlotIndex& slots = model.slots;
 
-                // visit origin after/same slot as visit destination => no need to consider
-                // (this also resolves when origin == destination, because they have the same slot)
-                if (vo.slot >= vd.slot) {
-                    va[agent][origin][destination] = NullVariable();
-                } else {
-                    va[agent][origin][destination] = mip.binary_variable(distance(vo.x, vo.y, vd.x, vd.y));
-                }
+    // Compact arc store (model.arcs, built before), only the arcs that can really be used are kept
+    // Visits are indexed from 0 here, in slot order
+    //     arcs[e] = visit origin -> visit destination, only when origin.slot < destination.slot
+    //               (this also resolves when origin == destination, because they have the same slot)
+    //               and, when pruning, only when destination is close to origin
+    //     outStart/inStart are CSR offsets, so the arcs leaving visit v are
+    //     arcs[outStart[v] .. outStart[v+1]) and the ones arriving at v are
+    //     inArcs[inStart[v] .. inStart[v+1])
+    // every agent shares the same visit-to-visit arcs, but has his own variables for them
+    const ArcStore& arcs = model.arcs;
+    model.addedOut.assign(numVisits, vector<int>());
+    model.addedIn.assign(numVisits, vector<int>());
+
+    // per agent variables
+    //     leave[a][v]  = "Agent a went from his house to visit v"
+    //     move[a][e]   = "Agent a went through arc e (visit to visit)"
+    //     back[a][v]   = "Agent a went from visit v to his house"
+    // agent always has to start and end at his own house, so there are no arcs to other houses
+    vector<AgentArcs>& va = model.va;
+    va.assign(numAgents, AgentArcs());
+    model.blocks.clear(); // the model may be built again on another solver (--compare-serial)
+
+    for (Agent a : agents) {
+        int agent = a.relative_index;
+        va[agent].leave.reserve(numVisits);
+        va[agent].back.reserve(numVisits);
+        va[agent].move.reserve(arcs.size());
+
+        const double *home = model.house.data() + agent * numVisits;
+        for (int vd = 0; vd < numVisits; ++vd) {
+            va[agent].leave.push_back(mip.binary_variable(home[vd]));
+        }
+        for (int vo = 0; vo < numVisits; ++vo) {
+            va[agent].back.push_back(mip.binary_variable(home[vo]));
+        }
+        for (int e = 0; e < arcs.size(); ++e) {
+            va[agent].move.push_back(mip.binary_variable(arcs.cost[e]));
+        }
+
+        addBlock(model, agent, LEAVE, 0, va[agent].leave, 0);
+        addBlock(model, agent, BACK, 0, va[agent].back, 0);
+        addBlock(model, agent, MOVE, 0, va[agent].move, 0);
+    }
+
+    // Every variable that brings some agent to visit d, built once and shared by all constraint families below
+    //     inflow[d] = [ leave[0][d], move[0][in arcs of d]..., leave[1][d], move[1][in arcs of d]..., ... ]
+    // so the part of agent a is the block of inflowStride(d) variables starting at a * inflowStride(d)
+    auto inflowStride = [&](int d) { return 1 + arcs.inStart[d + 1] - arcs.inStart[d]; };
+    vector<vector<Variable>> inflow(numVisits);
+    for (int destination = 0; destination < numVisits; ++destination) {
+        inflow[destination].reserve(numAgents * inflowStride(destination));
+        for (int agent = 0; agent < numAgents; ++agent) {
+            inflow[destination].push_back(va[agent].leave[destination]); // case when origin = agent house
+            for (int k = arcs.inStart[destination]; k < arcs.inStart[destination + 1]; ++k) {
+                inflow[destination].push_back(va[agent].move[arcs.inArcs[k]]);
             }
         }
     }
 
     // Restriction considering visits as destination
     // visits will either not happen (canceled) or at most one agent will participate
-    for (Visit vd : visits) {
-        int destination = vd.relative_index;
-        auto cons = mip.constraint();
-
-        for (Agent a : agents) {
-            int agent = a.relative_index;
-            cons.add_variable(va[agent][agent][destination], 1); // case when origin = agent house, already add
-            for (Visit vo : visits) {
-                int origin = vo.relative_index;
-                if (vo.slot < vd.slot) { // only consider if destination is after origin (origin == destination -> slot == slot, so this also guards against it)
-                    cons.add_variable(va[agent][origin][destination], 1);
-                }
-            }
-        }
-        cons.commit(0, 1);
+    model.visitRows.resize(numVisits);
+    for (int destination = 0; destination < numVisits; ++destination) {
+        model.visitRows[destination] = mip.add_row(inflow[destination].data(), inflow[destination].size(), 1, 0, 1);
     }
 
     // Restriction considering "continuity"
     // If an agent has visit V as destination he MUST have a visit with V as origin
+    model.continuityRows.assign(numAgents, vector<Row>(numVisits));
     for (Agent a : agents) {
         int agent = a.relative_index;
 
-        for (Visit vd : visits) {
-            int destination = vd.relative_index;
-            auto cons = mip.constraint();
-
-            // possible origins
-            for (Visit vo : visits) {
-                int possible_origin = vo.relative_index;
-                if (vo.slot < vd.slot) {
-                    cons.add_variable(va[agent][possible_origin][destination], 1);
-                }
-            }
+        for (int destination = 0; destination < numVisits; ++destination) {
+            auto& cons = mip.row();
 
-            // possible origin can also be the agent house! (agent 0 -> house 0)
-            cons.add_variable(va[agent][agent][destination], 1);
+            // possible origins, the agent house included (agent 0 -> house 0)
+            int stride = inflowStride(destination);
+            cons.add_variables(&inflow[destination][agent * stride], stride, 1);
 
-            // possible destination considering visit
-            for (Visit vd2 : visits) {
-                int possible_destination = vd2.relative_index;
-                if (vd2.slot > vd.slot) {
-                    cons.add_variable(va[agent][destination][possible_destination], -1);
-                }
-            }
+            // possible destination considering visit (arcs leaving it are contiguous)
+            int firstOut = arcs.outStart[destination];
+            cons.add_variables(va[agent].move.data() + firstOut, arcs.outStart[destination + 1] - firstOut, -1);
 
             // possible destination can also be the agent house! (agent 0 -> house 0)
-            cons.add_variable(va[agent][destination][agent], -1);
-
-            cons.commit(0, 0);
-        }
-    }
-
-    // Restriction considering number of visits on each slot (cant be more than number of available agents)
-    // At most cant be more than the number of agents so <= numAgents
-    // At mininum it's min(totalVisitsInSlot, numAgents) because:
-    //    - if in slot we have more visits than the number of agents,
-    //      then the minimum visits that happen is the number of agents (7 visits, 5 agents -> 5 visits happen)
-    //    - if in slot we have less visits than the number of agents,
-    //      then the minimum visits that happen is the number of visits (3 visits, 5 agents -> 3 visits happen)
-    for (auto visitSlot : visitsBySlot) {
-        vector<Visit> visitsInSlot = visitSlot.second;
-        int totalVisitsInSlot = visitsInSlot.size();
-
-        auto cons = mip.constraint();
-        for (Visit vd : visitsInSlot) {
-            int destination = vd.relative_index;
-            for (Agent a : agents) {
-                int agent = a.relative_index;
-                cons.add_variable(va[agent][agent][destination], 1); // case when origin = agent house, already add
-                for (Visit vo : visits) {
-                    int origin = vo.relative_index;
-                    if (vo.slot < vd.slot) { // only consider if destination is after origin (origin == destination -> slot == slot, so this also guards against it)
-                        cons.add_variable(va[agent][origin][destination], 1);
-                    }
-                }
-            }
+            cons.add_variable(va[agent].back[destination], -1);
+
+            model.continuityRows[agent][destination] = cons.commit(0, 0);
         }
-        cons.commit(min(totalVisitsInSlot, numAgents), numAgents);
     }
 
-    // Restriction because we can only have less than 5% visits "canceled"
-    //     -> that will have va[agent][origin][destination] = 0
-    // here I describe it the oposite way, if only less than 5% can be canceled
-    // then we know the ones that will happen are between 95% and 100%
-    int totalNumVisitors = 0;
-    for (Visit v : visits) { totalNumVisitors += v.pool_size; }
-    int numVisitors95 = totalNumVisitors * 0.95;
+    // Restriction considering number of visits on each slot, see slotLowerBound()
+    for (int s = 0; s < slots.size(); ++s) {
+        int slot = visits.slot[slots.slotStart[s]];
 
-    if(DEBUG) { cout << endl << "::::: Number of visits (visitors) that must happen are between " << numVisitors95 << " and " << totalNumVisitors << endl << endl; }
+        auto& cons = mip.row();
+        for (int destination = slots.slotStart[s]; destination < slots.slotStart[s + 1]; ++destination) {
+            cons.add_variables(inflow[destination].data(), inflow[destination].size(), 1);
+        }
+        model.slotRows[slot] = cons.commit(slotLowerBound(model, slot), numAgents);
+    }
 
-    auto cons = mip.constraint();
-    for (Visit vd : visits) {
-        int destination = vd.relative_index;
-        int visitors = vd.pool_size;
+    // Restriction considering the visitors that must be seen, see numVisitors95()
+    if(DEBUG) { cout << endl << "::::: Number of visits (visitors) that must happen are between " << numVisitors95(model) << " and " << model.totalNumVisitors << endl << endl; }
 
-        for (Agent a : agents) {
-            int agent = a.relative_index;
-            cons.add_variable(va[agent][agent][destination], visitors); // case when origin = agent house, already add
-            for (Visit vo : visits) {
-                int origin = vo.relative_index;
-                if (vo.slot < vd.slot) { // only consider if destination is after origin (origin == destination -> slot == slot, so this also guards against it)
-                    cons.add_variable(va[agent][origin][destination], visitors);
-                }
-            }
-        }
+    auto& cons = mip.row();
+    for (int destination = 0; destination < numVisits; ++destination) {
+        cons.add_variables(inflow[destination].data(), inflow[destination].size(), visits.pool_size[destination]);
     }
-    cons.commit(numVisitors95, totalNumVisitors);
+    model.coverageRow = cons.commit(numVisitors95(model), model.totalNumVisitors);
 
     // Restrictions about how every agent MUST start home
     // this means that for sure
-    //     va[a1][h1][v1] = "Agent a1 went from house1 to visit1"
-    // this must be true fixing [a1][h1] for exactly one visit as destination
+    //     leave[a1][v1] = "Agent a1 went from house1 to visit1"
+    // this must be true for exactly one visit as destination
+    model.startRows.resize(numAgents);
     for (Agent a : agents) {
         int agent = a.relative_index;
-        int origin = agent; // remember, agent 0 -> his house 0
 
-        auto cons = mip.constraint();
-        for (Visit v : visits) {
-            int destination = v.relative_index;
-            if (origin == destination) {
-                continue;
-            }
-            cons.add_variable(va[agent][origin][destination], 1);
-        }
-        cons.commit(0, 1); // can be 0 -> agent never left (no need, less visits than agents)
+        model.startRows[agent] = mip.add_row(va[agent].leave.data(), numVisits, 1, 0, 1); // can be 0 -> agent never left (no need, less visits than agents)
     }
 
     // Restrictions about how every agent MUST end at home
     // this means that for sure
-    //     va[a1][v2][h1] = "Agent a1 went from visit2 to house1"
-    // this must be true fixing [a1][...][h1] for exactly one visit as origin
-    //
-    // this is really similar to the previous restriction but
-    // pay attention to both "origin" and "destination" values here!
+    //     back[a1][v2] = "Agent a1 went from visit2 to house1"
+    // this must be true for exactly one visit as origin
+    model.endRows.resize(numAgents);
     for (Agent a : agents) {
         int agent = a.relative_index;
-        int destination = agent; // remember, agent 0 -> his house is 0
 
-        auto cons = mip.constraint();
-        for (Visit v : visits) {
-            int origin = v.relative_index;
-            if (origin == destination) {
-                continue;
-            }
-            cons.add_variable(va[agent][origin][destination], 1);
+        model.endRows[agent] = mip.add_row(va[agent].back.data(), numVisits, 1, 0, 1); // can be 0 -> agent never left (no need, less visits than agents)
+    }
+}
+
+// Flow formulation: the visit-to-visit arcs are shared, flow[e] = "some agent went through arc e",
+// and only leaving and coming back home are per agent, so the model has A (2V) + E arcs instead of A (2V + E).
+// Flow conservation alone would let a route leave one house and come back to another, so every visit
+// gets label[v] = the agent doing it (M = A - 1 is the largest label)
+//     leave[a][v] = 1 -> label[v] = a:    label[v] + sum_a (M - a) leave[a][v] <= M
+//                                        -label[v] + sum_a (M + a) leave[a][v] <= M
+//     back[a][v] = 1  -> label[v] = a:    same with back
+//     flow[e] = 1     -> label[o] = label[d]:  label[o] - label[d] + M flow[e] <= M, and the other way
+// so a whole route has the label of the house it left, and comes back to it.
+// Agents that would only be told apart by their arcs no longer are, which takes away most
+// of the symmetric branching. The incremental commands need the per agent rows, so they don't
+// work with this formulation.
+void buildFlowModel(MIPSolver& mip, Model& model) {
+    const vector<Agent>& agents = model.agents;
+    const Visits& visits = model.visits;
+    int numAgents = agents.size();
+    int numVisits = visits.size();
+    const SlotIndex& slots = model.slots;
+    const ArcStore& arcs = model.arcs;
+    int big = numAgents - 1;
+
+    vector<AgentArcs>& va = model.va;
+    va.assign(numAgents, AgentArcs());
+    model.blocks.clear(); // the model may be built again on another solver (--compare-serial)
+    for (int agent = 0; agent < numAgents; ++agent) {
+        const double *home = model.house.data() + agent * numVisits;
+        va[agent].leave.reserve(numVisits);
+        va[agent].back.reserve(numVisits);
+        for (int v = 0; v < numVisits; ++v) {
+            va[agent].leave.push_back(mip.binary_variable(home[v]));
+        }
+        for (int v = 0; v < numVisits; ++v) {
+            va[agent].back.push_back(mip.binary_variable(home[v]));
+        }
+        addBlock(model, agent, LEAVE, 0, va[agent].leave, 0);
+        addBlock(model, agent, BACK, 0, va[agent].back, 0);
+    }
+    model.flow.clear();
+    model.label.clear();
+    model.flow.reserve(arcs.size());
+    for (int e = 0; e < arcs.size(); ++e) {
+        model.flow.push_back(mip.binary_variable(arcs.cost[e]));
+    }
+    addBlock(model, -1, MOVE, 0, model.flow, 0);
+    if (numAgents > 1) {
+        model.label.reserve(numVisits);
+        for (int v = 0; v < numVisits; ++v) {
+            model.label.push_back(mip.integer_variable(0, big, 0));
         }
-        cons.commit(0, 1); // can be 0 -> agent never left (no need, less visits than agents)
     }
 
-    // Solve and print
-    mip.set_time_limit(300); // 5 minutes
-    auto sol = mip.solve();
+    // Every variable that brings some agent to visit d: leave[0][d] .. leave[A-1][d], then flow[in arcs of d]
+    vector<vector<Variable>> inflow(numVisits);
+    for (int destination = 0; destination < numVisits; ++destination) {
+        inflow[destination].reserve(numAgents + arcs.inStart[destination + 1] - arcs.inStart[destination]);
+        for (int agent = 0; agent < numAgents; ++agent) {
+            inflow[destination].push_back(va[agent].leave[destination]);
+        }
+        for (int k = arcs.inStart[destination]; k < arcs.inStart[destination + 1]; ++k) {
+            inflow[destination].push_back(model.flow[arcs.inArcs[k]]);
+        }
+    }
 
-    cout << endl;
+    // at most one agent per visit, and whoever comes in goes out (to another visit or home)
+    model.visitRows.resize(numVisits);
+    for (int destination = 0; destination < numVisits; ++destination) {
+        model.visitRows[destination] = mip.add_row(inflow[destination].data(), inflow[destination].size(), 1, 0, 1);
+
+        auto& cons = mip.row();
+        cons.add_variables(inflow[destination].data(), inflow[destination].size(), 1);
+        int firstOut = arcs.outStart[destination];
+        cons.add_variables(model.flow.data() + firstOut, arcs.outStart[destination + 1] - firstOut, -1);
+        for (int agent = 0; agent < numAgents; ++agent) {
+            cons.add_variable(va[agent].back[destination], -1);
+        }
+        cons.commit(0, 0);
+    }
+
+    // visits per slot and visitors, as in buildModel
+    for (int s = 0; s < slots.size(); ++s) {
+        int slot = visits.slot[slots.slotStart[s]];
+        auto& cons = mip.row();
+        for (int destination = slots.slotStart[s]; destination < slots.slotStart[s + 1]; ++destination) {
+            cons.add_variables(inflow[destination].data(), inflow[destination].size(), 1);
+        }
+        model.slotRows[slot] = cons.commit(slotLowerBound(model, slot), numAgents);
+    }
+
+    if(DEBUG) { cout << endl << "::::: Number of visits (visitors) that must happen are between " << numVisitors95(model) << " and " << model.totalNumVisitors << endl << endl; }
+
+    auto& cons = mip.row();
+    for (int destination = 0; destination < numVisits; ++destination) {
+        cons.add_variables(inflow[destination].data(), inflow[destination].size(), visits.pool_size[destination]);
+    }
+    model.coverageRow = cons.commit(numVisitors95(model), model.totalNumVisitors);
+
+    // every agent leaves home at most once and comes back at most once
+    model.startRows.resize(numAgents);
+    model.endRows.resize(numAgents);
     for (int agent = 0; agent < numAgents; ++agent) {
-        cout << "Agent " << agent << " (House " << agent << ")" << endl;
-        for (int origin = 0; origin < totalNumPlaces; ++origin) {
-            for (int destination = 0; destination < totalNumPlaces; ++destination) {
-                if (sol.value(va[agent][origin][destination]) > 0.5) {
-                    cout << "Went from ";
-                    if (origin < numAgents) {
-                        cout << "House " << origin;
-                    } else {
-                        cout << "Visit " << origin - numAgents;
-                    }
-                    cout << " to ";
-                    if (destination < numAgents) {
-                        cout << "House " << destination;
-                    } else {
-                        cout << "Visit " << destination - numAgents;
+        model.startRows[agent] = mip.add_row(va[agent].leave.data(), numVisits, 1, 0, 1);
+        model.endRows[agent] = mip.add_row(va[agent].back.data(), numVisits, 1, 0, 1);
+    }
+
+    // labels, see above
+    if (numAgents > 1) {
+        for (int v = 0; v < numVisits; ++v) {
+            for (int end = 0; end < 2; ++end) {
+                for (int sign = -1; sign <= 1; sign += 2) {
+                    auto& tie = mip.row();
+                    tie.add_variable(model.label[v], -sign);
+                    for (int agent = 0; agent < numAgents; ++agent) {
+                        tie.add_variable(end == 0 ? va[agent].leave[v] : va[agent].back[v], big + sign * agent);
                     }
-                    cout << endl;
+                    tie.commit(-big, big); // -M is as low as these rows go
                 }
             }
         }
-        cout << endl;
+        for (int e = 0; e < arcs.size(); ++e) {
+            for (int sign = -1; sign <= 1; sign += 2) {
+                auto& tie = mip.row();
+                tie.add_variable(model.label[arcs.origin[e]], sign);
+                tie.add_variable(model.label[arcs.destination[e]], -sign);
+                tie.add_variable(model.flow[e], big);
+                tie.commit(-big, big);
+            }
+        }
+    }
+}
+
+// Route formulation (branch-and-price): one column per route an agent could take, in a set
+// partitioning master
+//     every agent takes at most one route                         startRows[a]  <= 1
+//     at most one agent per visit                                 visitRows[v]  <= 1
+//     visits per slot and visitors, as in buildModel              slotRows, coverageRow
+// There are far too many routes to list, so the master starts with the routes of the starting
+// solutions and RoutePricer adds the ones that can lower the LP: with the duals y of the rows, a
+// route of agent a has reduced cost
+//     distance - y[startRows[a]] - sum over its visits v of w[v]
+//     w[v] = y[visitRows[v]] + y[slotRows[slot of v]] + pool_size[v] * y[coverageRow]
+// which is the shortest path of lagrangianBound() with w as the visit weights, one pass over the
+// arcs arriving at each visit (the arcs are still listed once, but no agent has variables for them).
+// The LP bound of the master is the best Lagrangian bound.
+// Branching on a column does not hold (pricing would bring it back), so the search branches on
+// the arcs of the routes instead: an arc is used (a route through either end takes it, and a row
+// of the node asks for a flow of 1 on it) or not (no route takes it). When every arc has an
+// integer flow the routes are integer too.
+
+// Adds the column of a route to the master, before solving (mip) or while pricing, where it also
+// joins the rows of the "used" decisions it takes
+Variable addRouteColumn(Model& model, MIPSolver *mip, Pricing *pricing, const RouteColumn& column,
+                        const vector<Row>& decisionRows = vector<Row>()) {
+    int numVisits = model.visits.size();
+    const double *home = model.house.data() + column.agent * numVisits;
+    vector<Row> rows(1, model.startRows[column.agent]);
+    vector<double> vals(1, 1.0);
+    double cost = home[column.visits.front()] + home[column.visits.back()];
+    int visitors = 0;
+    for (int i = 0; i < (int) column.visits.size(); ++i) {
+        int v = column.visits[i];
+        rows.push_back(model.visitRows[v]);
+        rows.push_back(model.slotRows[model.visits.slot[v]]);
+        vals.push_back(1);
+        vals.push_back(1);
+        visitors += model.visits.pool_size[v];
+        if (i > 0) {
+            int o = column.visits[i - 1];
+            cost += distance(model.visits.x[o], model.visits.y[o], model.visits.x[v], model.visits.y[v]);
+        }
+    }
+    rows.push_back(model.coverageRow);
+    vals.push_back(visitors);
+    for (const Row& row : decisionRows) {
+        rows.push_back(row);
+        vals.push_back(1);
+    }
+
+    Variable var = pricing != NULL ? pricing->add_column(cost, rows.data(), vals.data(), rows.size())
+                                   : mip->add_column(cost, rows.data(), vals.data(), rows.size());
+    if (model.columns.empty()) {
+        model.firstColumn = var.index();
+    }
+    model.columns.push_back(column);
+    model.columnVars.push_back(var);
+    return var;
+}
+
+// Prices and branches for the route master, see above
+struct RoutePricer : public ColumnGenerator {
+    Model& model;
+    vector<ArcDecision> decisions; // every decision branched on, by number
+
+    // what the decisions of a node leave to the pricing
+    vector<char> arcBlocked;
+    vector<int> blockedArcs;
+    vector<int> firstAgent, lastAgent;  // by visit: -1 any agent, -2 none, or the only agent it can start / end
+    vector<int> agentFirst, agentLast;  // by agent: -1 any visit, -2 none, or the only visit it can start / end at
+    vector<vector<int>> noLeave, noBack; // by agent
+
+    // the "used" decisions of a node with their row duals, rewards for the routes taking them
+    vector<double> moveDual;
+    vector<pair<int, double>> leaveDual, backDual; // (decision, dual)
+
+    explicit RoutePricer(Model& model) : model(model) {}
+
+    // whether a route takes the arc of a decision
+    bool takes(const RouteColumn& column, const ArcDecision& d) const {
+        const vector<int>& route = column.visits;
+        if (d.kind == MOVE) {
+            int o = find(route.begin(), route.end(), model.arcs.origin[d.at]) - route.begin();
+            return o + 1 < (int) route.size() && route[o + 1] == model.arcs.destination[d.at];
+        }
+        return column.agent == d.agent && (d.kind == LEAVE ? route.front() : route.back()) == d.at;
+    }
+
+    // x becomes value, unless it already is another one (then nothing is left, -2)
+    static void only(int& x, int value) {
+        x = x == -1 || x == value ? value : -2;
+    }
+
+    void block(int e) {
+        if (!arcBlocked[e]) {
+            arcBlocked[e] = 1;
+            blockedArcs.push_back(e);
+        }
+    }
+
+    // every arc leaving (or arriving at) v but keep
+    void blockOut(int v, int keep) {
+        for (int e = model.arcs.outStart[v]; e < model.arcs.outStart[v + 1]; ++e) {
+            if (e != keep) {
+                block(e);
+            }
+        }
+    }
+    void blockIn(int v, int keep) {
+        for (int k = model.arcs.inStart[v]; k < model.arcs.inStart[v + 1]; ++k) {
+            if (model.arcs.inArcs[k] != keep) {
+                block(model.arcs.inArcs[k]);
+            }
+        }
+    }
+
+    void applyDecisions(const vector<int>& numbers) {
+        const ArcStore& arcs = model.arcs;
+        int numAgents = model.agents.size();
+        int numVisits = model.visits.size();
+
+        arcBlocked.resize(arcs.size(), 0);
+        for (int e : blockedArcs) {
+            arcBlocked[e] = 0;
+        }
+        blockedArcs.clear();
+        firstAgent.assign(numVisits, -1);
+        lastAgent.assign(numVisits, -1);
+        agentFirst.assign(numAgents, -1);
+        agentLast.assign(numAgents, -1);
+        noLeave.assign(numAgents, vector<int>());
+        noBack.assign(numAgents, vector<int>());
+
+        for (int number : numbers) {
+            const ArcDecision& d = decisions[number];
+            if (d.kind == MOVE) {
+                int o = arcs.origin[d.at], t = arcs.destination[d.at];
+                if (!d.used) {
+                    block(d.at);
+                    continue;
+                }
+                blockOut(o, d.at);
+                blockIn(t, d.at);
+                lastAgent[o] = -2;
+                firstAgent[t] = -2;
+            } else if (d.kind == LEAVE) {
+                if (!d.used) {
+                    noLeave[d.agent].push_back(d.at);
+                    continue;
+                }
+                blockIn(d.at, -1);
+                only(firstAgent[d.at], d.agent);
+                only(agentFirst[d.agent], d.at);
+            } else {
+                if (!d.used) {
+                    noBack[d.agent].push_back(d.at);
+                    continue;
+                }
+                blockOut(d.at, -1);
+                only(lastAgent[d.at], d.agent);
+                only(agentLast[d.agent], d.at);
+            }
+        }
     }
 
+    // one shortest path per agent over the slot DAG, see buildRouteMaster
+    // with an infeasible LP the duals are Farkas multipliers and distances don't count
+    void price(Pricing& pricing) override {
+        const Visits& visits = model.visits;
+        const SlotIndex& slots = model.slots;
+        const ArcStore& arcs = model.arcs;
+        int numAgents = model.agents.size();
+        int numVisits = visits.size();
+        double k = pricing.objective_weight();
+        const double none = 1e100;
+        applyDecisions(pricing.decisions());
+
+        moveDual.assign(arcs.size(), 0);
+        leaveDual.clear();
+        backDual.clear();
+        for (int number : pricing.decisions()) {
+            const ArcDecision& d = decisions[number];
+            Row row = pricing.decision_row(number);
+            if (!row.valid()) {
+                continue;
+            }
+            double y = pricing.dual(row);
+            if (d.kind == MOVE) {
+                moveDual[d.at] += y;
+            } else {
+                (d.kind == LEAVE ? leaveDual : backDual).push_back(make_pair(number, y));
+            }
+        }
+        vector<double> leaveReward(numVisits, 0), backReward(numVisits, 0);
+
+        vector<double> slotDual(slots.size());
+        for (int s = 0; s < slots.size(); ++s) {
+            slotDual[s] = pricing.dual(model.slotRows[visits.slot[slots.slotStart[s]]]);
+        }
+        double coverageDual = pricing.dual(model.coverageRow);
+        vector<double> w(numVisits);
+        for (int v = 0; v < numVisits; ++v) {
+            w[v] = pricing.dual(model.visitRows[v]) + slotDual[slots.slotOf[v]] + visits.pool_size[v] * coverageDual;
+        }
+
+        vector<double> best(numVisits);
+        vector<int> pred(numVisits);
+        vector<char> leaveOk(numVisits), backOk(numVisits);
+        double bound = pricing.lp_objective();
+        for (int agent = 0; agent < numAgents; ++agent) {
+            const double *home = model.house.data() + agent * numVisits;
+            for (int v = 0; v < numVisits; ++v) {
+                leaveOk[v] = (firstAgent[v] == -1 || firstAgent[v] == agent) && (agentFirst[agent] == -1 || agentFirst[agent] == v);
+                backOk[v] = (lastAgent[v] == -1 || lastAgent[v] == agent) && (agentLast[agent] == -1 || agentLast[agent] == v);
+            }
+            for (int v : noLeave[agent]) {
+                leaveOk[v] = 0;
+            }
+            for (int v : noBack[agent]) {
+                backOk[v] = 0;
+            }
+            for (auto& y : leaveDual) {
+                if (decisions[y.first].agent == agent) {
+                    leaveReward[decisions[y.first].at] += y.second;
+                }
+            }
+            for (auto& y : backDual) {
+                if (decisions[y.first].agent == agent) {
+                    backReward[decisions[y.first].at] += y.second;
+                }
+            }
+
+            int end = -1;
+            double endCost = none;
+            for (int v = 0; v < numVisits; ++v) {
+                best[v] = leaveOk[v] ? k * home[v] - leaveReward[v] : none;
+                pred[v] = -1;
+                for (int j = arcs.inStart[v]; j < arcs.inStart[v + 1]; ++j) {
+                    int e = arcs.inArcs[j];
+                    double cost = best[arcs.origin[e]] + k * arcs.cost[e] - moveDual[e];
+                    if (!arcBlocked[e] && cost < best[v]) {
+                        best[v] = cost;
+                        pred[v] = arcs.origin[e];
+                    }
+                }
+                if (best[v] >= none) {
+                    continue;
+                }
+                best[v] -= w[v];
+                if (backOk[v] && best[v] + k * home[v] - backReward[v] < endCost) {
+                    endCost = best[v] + k * home[v] - backReward[v];
+                    end = v;
+                }
+            }
+            for (auto& y : leaveDual) {
+                leaveReward[decisions[y.first].at] = 0;
+            }
+            for (auto& y : backDual) {
+                backReward[decisions[y.first].at] = 0;
+            }
+            if (end < 0) {
+                continue;
+            }
+
+            double reducedCost = endCost - pricing.dual(model.startRows[agent]);
+            bound += min(0.0, reducedCost);
+            if (reducedCost < -1e-6) {
+                RouteColumn column;
+                column.agent = agent;
+                for (int v = end; v >= 0; v = pred[v]) {
+                    column.visits.push_back(v);
+                }
+                reverse(column.visits.begin(), column.visits.end());
+                vector<Row> decisionRows;
+                for (int number : pricing.decisions()) {
+                    Row row = pricing.decision_row(number);
+                    if (row.valid() && takes(column, decisions[number])) {
+                        decisionRows.push_back(row);
+                    }
+                }
+                addRouteColumn(model, NULL, &pricing, column, decisionRows);
+            }
+        }
+
+        // every agent takes at most one route, so the LP can't go lower than this
+        if (!pricing.farkas()) {
+            pricing.set_lower_bound(bound);
+        }
+    }
+
+    // the most fractional arc of the LP routes not decided yet, "not used" on the left and "used"
+    // on the right. With every flow integral the routes are too, so false never leaves fractional
+    // columns behind: an agent's routes all leave from its one visit of flow 1, which they fill, and
+    // from there every visit has one arc of flow 1 on (or its back arc), which they all take
+    bool branch(const Solution& lp, const vector<int>& numbers, int *left, int *right) override {
+        SolutionValues values = lp.values();
+        map<pair<int, int>, double> leave, back;
+        map<int, double> move;
+        for (int k = 0; k < (int) model.columns.size(); ++k) {
+            double x = values[model.columnVars[k]];
+            if (x < 1e-6) {
+                continue;
+            }
+            const RouteColumn& column = model.columns[k];
+            leave[make_pair(column.agent, column.visits.front())] += x;
+            back[make_pair(column.agent, column.visits.back())] += x;
+            for (int i = 0; i + 1 < (int) column.visits.size(); ++i) {
+                int e = findArc(model.arcs, column.visits[i], column.visits[i + 1]);
+                if (e >= 0) {
+                    move[e] += x;
+                }
+            }
+        }
+
+        ArcDecision chosen = { MOVE, -1, -1, false };
+        double gap = 0.5 - 1e-6; // from 0.5, anything closer than this is fractional
+        auto decided = [&](ArcKind kind, int agent, int at) {
+            for (int number : numbers) {
+                const ArcDecision& d = decisions[number];
+                if (d.kind == kind && d.agent == agent && d.at == at) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        auto consider = [&](ArcKind kind, int agent, int at, double flow) {
+            if (fabs(flow - 0.5) < gap && !decided(kind, agent, at)) {
+                gap = fabs(flow - 0.5);
+                ArcDecision d = { kind, agent, at, false };
+                chosen = d;
+            }
+        };
+        for (auto& f : leave) {
+            consider(LEAVE, f.first.first, f.first.second, f.second);
+        }
+        for (auto& f : back) {
+            consider(BACK, f.first.first, f.first.second, f.second);
+        }
+        for (auto& f : move) {
+            consider(MOVE, -1, f.first, f.second);
+        }
+        if (chosen.at < 0) {
+            return false;
+        }
+
+        *left = decisions.size();
+        decisions.push_back(chosen);
+        chosen.used = true;
+        *right = decisions.size();
+        decisions.push_back(chosen);
+        return true;
+    }
+
+    bool allowed(const Variable& var, const vector<int>& numbers) override {
+        int k = var.index() - model.firstColumn;
+        if (k < 0 || k >= (int) model.columns.size()) {
+            return true;
+        }
+        const RouteColumn& column = model.columns[k];
+        const vector<int>& route = column.visits;
+        auto position = [&](int v) { return find(route.begin(), route.end(), v) - route.begin(); };
+        int size = route.size();
+
+        for (int number : numbers) {
+            const ArcDecision& d = decisions[number];
+            bool touches;
+            if (d.kind == MOVE) {
+                touches = position(model.arcs.origin[d.at]) < size || position(model.arcs.destination[d.at]) < size;
+            } else {
+                touches = column.agent == d.agent || position(d.at) < size;
+            }
+            if (d.used ? touches && !takes(column, d) : takes(column, d)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // "used" asks for a flow of at least 1 on the arc, over the routes taking it
+    bool decision_row(int number, double *lower) override {
+        *lower = 1;
+        return decisions[number].used;
+    }
+
+    double coefficient(const Variable& var, int number) override {
+        int k = var.index() - model.firstColumn;
+        if (k < 0 || k >= (int) model.columns.size()) {
+            return 0;
+        }
+        return takes(model.columns[k], decisions[number]) ? 1 : 0;
+    }
+};
+
+void buildRouteMaster(MIPSolver& mip, Model& model, RoutePricer& pricer) {
+    const Visits& visits = model.visits;
+    const SlotIndex& slots = model.slots;
+    int numAgents = model.agents.size();
+    int numVisits = visits.size();
+
+    mip.generate_columns(&pricer);
+    model.blocks.clear();
+    model.columns.clear();
+    model.columnVars.clear();
+    model.firstColumn = 0;
+    model.va.clear();
+
+    // rows start empty, every column adds itself to them (see addRouteColumn)
+    model.startRows.resize(numAgents);
+    for (int agent = 0; agent < numAgents; ++agent) {
+        model.startRows[agent] = mip.row().commit(0, 1);
+    }
+    model.visitRows.resize(numVisits);
+    for (int v = 0; v < numVisits; ++v) {
+        model.visitRows[v] = mip.row().commit(0, 1);
+    }
+    for (int s = 0; s < slots.size(); ++s) {
+        int slot = visits.slot[slots.slotStart[s]];
+        model.slotRows[slot] = mip.row().commit(slotLowerBound(model, slot), numAgents);
+    }
+    if(DEBUG) { cout << endl << "::::: Number of visits (visitors) that must happen are between " << numVisitors95(model) << " and " << model.totalNumVisitors << endl << endl; }
+    model.coverageRow = mip.row().commit(numVisitors95(model), model.totalNumVisitors);
+}
+
+// Incremental mode: a new visit gets new columns for its arcs (only to visits that were not cancelled)
+// and its own rows, and its arcs are added to the rows of the visits they touch
+int addVisit(MIPSolver& mip, Model& model, Visit visit) {
+    int numAgents = model.agents.size();
+    int n = model.visits.size();
+    model.visits.push_back(visit);
+    model.cancelled.push_back(false);
+    model.addedOut.push_back(vector<int>());
+    model.addedIn.push_back(vector<int>());
+
+    ArcStore& arcs = model.arcs;
+    int firstArc = arcs.size();
+    for (int v = 0; v < n; ++v) {
+        int slot = model.visits.slot[v];
+        if (model.cancelled[v] || slot == visit.slot) {
+            continue;
+        }
+        int o = slot < visit.slot ? v : n;
+        int d = slot < visit.slot ? n : v;
+        model.addedOut[o].push_back(arcs.size());
+        model.addedIn[d].push_back(arcs.size());
+        arcs.origin.push_back(o);
+        arcs.destination.push_back(d);
+        arcs.cost.push_back(distance(model.visits.x[o], model.visits.y[o], model.visits.x[d], model.visits.y[d]));
+    }
+
+    // new columns
+    for (Agent a : model.agents) {
+        int agent = a.relative_index;
+        AgentArcs& mine = model.va[agent];
+        mine.leave.push_back(mip.binary_variable(distance(a.x, a.y, visit.x, visit.y)));
+        mine.back.push_back(mip.binary_variable(distance(visit.x, visit.y, a.x, a.y)));
+        for (int e = firstArc; e < arcs.size(); ++e) {
+            mine.move.push_back(mip.binary_variable(arcs.cost[e]));
+        }
+        addBlock(model, agent, LEAVE, n, mine.leave, n);
+        addBlock(model, agent, BACK, n, mine.back, n);
+        addBlock(model, agent, MOVE, firstArc, mine.move, firstArc);
+    }
+
+    // rows of the new visit
+    if (!model.slotRows.count(visit.slot)) {
+        model.slotVisits[visit.slot] = 0;
+        model.slotRows[visit.slot] = mip.row().commit(0, numAgents);
+    }
+    model.slotVisits[visit.slot]++;
+    model.totalNumVisitors += visit.pool_size;
+
+    model.visitRows.push_back(mip.row().commit(0, 1));
+    for (int agent = 0; agent < numAgents; ++agent) {
+        model.continuityRows[agent].push_back(mip.row().commit(0, 0));
+    }
+
+    // every arc arriving at a visit is part of its inflow: at most once, continuity, slot and coverage
+    auto addInflow = [&](int agent, int d, const Variable& var) {
+        mip.add_to_row(model.visitRows[d], var, 1);
+        mip.add_to_row(model.continuityRows[agent][d], var, 1);
+        mip.add_to_row(model.slotRows[model.visits.slot[d]], var, 1);
+        mip.add_to_row(model.coverageRow, var, model.visits.pool_size[d]);
+    };
+    for (int agent = 0; agent < numAgents; ++agent) {
+        AgentArcs& mine = model.va[agent];
+        addInflow(agent, n, mine.leave[n]);
+        mip.add_to_row(model.startRows[agent], mine.leave[n], 1);
+        mip.add_to_row(model.continuityRows[agent][n], mine.back[n], -1);
+        mip.add_to_row(model.endRows[agent], mine.back[n], 1);
+        for (int e = firstArc; e < arcs.size(); ++e) {
+            addInflow(agent, arcs.destination[e], mine.move[e]);
+            mip.add_to_row(model.continuityRows[agent][arcs.origin[e]], mine.move[e], -1);
+        }
+    }
+
+    mip.set_row_bounds(model.slotRows[visit.slot], slotLowerBound(model, visit.slot), numAgents);
+    mip.set_row_bounds(model.coverageRow, numVisitors95(model), model.totalNumVisitors);
+    return n;
+}
+
+// Incremental mode: a cancelled visit keeps its columns, but nothing can arrive at it anymore
+// (so by continuity nothing leaves it either), and it no longer counts for its slot and coverage
+void cancelVisit(MIPSolver& mip, Model& model, int v) {
+    if (model.cancelled[v]) {
+        return;
+    }
+    model.cancelled[v] = true;
+
+    vector<int> in(model.addedIn[v]);
+    if (v < (int) model.slots.slotOf.size()) {
+        const ArcStore& arcs = model.arcs;
+        in.insert(in.end(), arcs.inArcs.begin() + arcs.inStart[v], arcs.inArcs.begin() + arcs.inStart[v + 1]);
+    }
+    for (AgentArcs& mine : model.va) {
+        mip.set_bounds(mine.leave[v], 0, 0);
+        for (int e : in) {
+            mip.set_bounds(mine.move[e], 0, 0);
+        }
+    }
+
+    Visit visit = model.visits.at(v);
+    model.slotVisits[visit.slot]--;
+    model.totalNumVisitors -= visit.pool_size;
+    mip.set_row_bounds(model.slotRows[visit.slot], slotLowerBound(model, visit.slot), model.agents.size());
+    mip.set_row_bounds(model.coverageRow, numVisitors95(model), model.totalNumVisitors);
+}
+
+// Takes cancelled visits out of the routes, the agent goes straight from the visit before to the one after
+void repairRoutes(const Model& model, Routes& routes) {
+    routes.next.resize(model.visits.size(), -1);
+    for (int agent = 0; agent < (int) routes.first.size(); ++agent) {
+        while (routes.first[agent] >= 0 && model.cancelled[routes.first[agent]]) {
+            routes.first[agent] = routes.next[routes.first[agent]];
+        }
+        for (int v = routes.first[agent]; v >= 0; v = routes.next[v]) {
+            while (routes.next[v] >= 0 && model.cancelled[routes.next[v]]) {
+                routes.next[v] = routes.next[routes.next[v]];
+            }
+        }
+    }
+}
+
+// Feeds routes to SCIP as the solution to start from
+// a partial start only fixes the arcs of the routes and leaves the rest for SCIP to complete
+bool addStart(MIPSolver& mip, const Model& model, const Routes& routes, bool partial) {
+    vector<Variable> chosen;
+    vector<double> values;
+    for (int agent = 0; agent < (int) routes.first.size(); ++agent) {
+        int v = routes.first[agent];
+        if (v < 0) {
+            continue;
+        }
+        const AgentArcs& mine = model.va[agent];
+        const vector<Variable>& move = model.flow.empty() ? mine.move : model.flow;
+        chosen.push_back(mine.leave[v]);
+        values.push_back(1);
+        while (v >= 0) {
+            if (!model.label.empty()) {
+                chosen.push_back(model.label[v]);
+                values.push_back(agent);
+            }
+            if (routes.next[v] < 0) {
+                break;
+            }
+            int e = findArc(model, v, routes.next[v]);
+            if (e < 0) {
+                return false;
+            }
+            chosen.push_back(move[e]);
+            values.push_back(1);
+            v = routes.next[v];
+        }
+        chosen.push_back(mine.back[v]);
+        values.push_back(1);
+    }
+    return mip.add_solution(chosen.data(), values.data(), chosen.size(), partial);
+}
+
+// Same for the route formulation: the routes become columns (unless they already are one)
+bool addRouteStart(MIPSolver& mip, Model& model, const Routes& routes, bool partial) {
+    vector<Variable> chosen;
+    vector<double> values;
+    for (int agent = 0; agent < (int) routes.first.size(); ++agent) {
+        RouteColumn column;
+        column.agent = agent;
+        for (int v = routes.first[agent]; v >= 0; v = routes.next[v]) {
+            if (!column.visits.empty() && findArc(model.arcs, column.visits.back(), v) < 0) {
+                return false;
+            }
+            column.visits.push_back(v);
+        }
+        if (column.visits.empty()) {
+            continue;
+        }
+        int k = 0;
+        while (k < (int) model.columns.size() &&
+               (model.columns[k].agent != agent || model.columns[k].visits != column.visits)) {
+            ++k;
+        }
+        chosen.push_back(k < (int) model.columns.size() ? model.columnVars[k] : addRouteColumn(model, &mip, NULL, column));
+        values.push_back(1);
+    }
+    return mip.add_solution(chosen.data(), values.data(), chosen.size(), partial);
+}
+
+// Reads routes printed by a previous run (say yesterday's), only the lines
+//     Agent <a> (House <a>)
+//     Went from <...> to Visit <k>
+// matter. Visits that are unknown, cancelled, already taken or out of slot order are left out.
+Routes readStartRoutes(istream& in, const Model& model) {
+    int numAgents = model.agents.size();
+    vector<int> byNumber;
+    for (int v = 0; v < (int) model.visits.size(); ++v) {
+        int number = model.visits.relative_index[v] - numAgents;
+        if (number >= (int) byNumber.size()) {
+            byNumber.resize(number + 1, -1);
+        }
+        byNumber[number] = v;
+    }
+
+    Routes routes;
+    routes.first.assign(numAgents, -1);
+    routes.next.assign(model.visits.size(), -1);
+    vector<bool> taken(model.visits.size(), false);
+    int agent = -1, last = -1;
+    string line;
+    while (getline(in, line)) {
+        int a, number;
+        if (sscanf(line.c_str(), "Agent %d (House", &a) == 1) {
+            agent = a >= 0 && a < numAgents ? a : -1;
+            last = -1;
+            continue;
+        }
+        size_t to = line.rfind(" to Visit ");
+        if (agent < 0 || line.compare(0, 10, "Went from ") || to == string::npos ||
+            sscanf(line.c_str() + to, " to Visit %d", &number) != 1) {
+            continue;
+        }
+        int v = number >= 0 && number < (int) byNumber.size() ? byNumber[number] : -1;
+        if (v < 0 || taken[v] || model.cancelled[v] ||
+            (last >= 0 && model.visits.slot[last] >= model.visits.slot[v])) {
+            continue;
+        }
+        taken[v] = true;
+        if (last < 0) {
+            routes.first[agent] = v;
+        } else {
+            routes.next[last] = v;
+        }
+        last = v;
+    }
+
+    return routes;
+}
+
+// Result cache (see --cache): routes are kept under a hash of everything that shapes the model,
+// the agents and visits (after sorting by slot, so indexes match) and the arc pruning,
+// along with whether SCIP proved them optimal
+string cacheKey(const Model& model, int nearest, double radius) {
+    Hasher hasher;
+    hasher.add(string("agents routes 1"));
+    for (const Agent& a : model.agents) {
+        hasher.add(a.x);
+        hasher.add(a.y);
+    }
+    hasher.add(model.visits.relative_index);
+    hasher.add(model.visits.slot);
+    hasher.add(model.visits.pool_size);
+    hasher.add(model.visits.x);
+    hasher.add(model.visits.y);
+    hasher.add(nearest);
+    hasher.add(radius);
+    return "agents-" + hasher.hex();
+}
+
+void storeRoutes(const ResultCache& cache, const string& key, const Routes& routes, bool optimal) {
+    Record record;
+    record.put(optimal);
+    record.put(routes.first);
+    record.put(routes.next);
+    cache.store(key, record);
+}
+
+// False when there is no entry or it doesn't fit the model: every visit once at most
+// and routes in increasing slots
+bool loadRoutes(const ResultCache& cache, const string& key, const Model& model, Routes& routes, bool& optimal) {
+    Record record;
+    if (!cache.load(key, &record) || !record.get(&optimal) || !record.get(&routes.first) || !record.get(&routes.next) ||
+        routes.first.size() != model.agents.size() || (int) routes.next.size() != model.visits.size()) {
+        return false;
+    }
+    vector<bool> seen(routes.next.size(), false);
+    for (int agent = 0; agent < (int) routes.first.size(); ++agent) {
+        int last = -1;
+        for (int v = routes.first[agent]; v >= 0; v = routes.next[v]) {
+            if (v >= (int) seen.size() || seen[v] || (last >= 0 && model.visits.slot[last] >= model.visits.slot[v])) {
+                return false;
+            }
+            seen[v] = true;
+            last = v;
+        }
+    }
+    return true;
+}
+
+// Distances between every house and every visit, computed once for the greedy routes,
+// the Lagrangian and the leave/back costs of every agent
+void buildHouseDistances(Model& model) {
+    int numVisits = model.visits.size();
+    model.house.resize(model.agents.size() * numVisits);
+    for (int agent = 0; agent < (int) model.agents.size(); ++agent) {
+        distances(model.agents[agent].x, model.agents[agent].y, model.visits.x.data(), model.visits.y.data(), numVisits,
+                  model.house.data() + agent * numVisits);
+    }
+}
+
+// Greedy construction heuristic, walking the slots in order
+// an agent is either at his house or at his last visit, and in each slot the closest
+// (agent, visit) pairs are taken first until every agent is busy or every visit of the slot is done
+// (so the slot restrictions always hold, only the 95% visitors one may not)
+Routes greedyRoutes(const Model& model) {
+    const vector<Agent>& agents = model.agents;
+    const Visits& visits = model.visits;
+    const SlotIndex& slots = model.slots;
+    int numAgents = agents.size();
+
+    Routes routes;
+    routes.first.assign(numAgents, -1);
+    routes.next.assign(visits.size(), -1);
+    vector<int> last(numAgents, -1);
+
+    struct Pair {
+        double cost;
+        int agent, visit;
+        bool operator<(const Pair& other) const { return cost < other.cost; }
+    };
+    vector<Pair> pairs;
+    vector<bool> busy(numAgents), done;
+    vector<double> dist;
+
+    for (int s = 0; s < slots.size(); ++s) {
+        int begin = slots.slotStart[s], end = slots.slotStart[s + 1];
+        pairs.clear();
+        dist.resize(end - begin);
+        for (int agent = 0; agent < numAgents; ++agent) {
+            const double *from = model.house.data() + agent * visits.size() + begin;
+            if (last[agent] >= 0) {
+                distances(visits.x[last[agent]], visits.y[last[agent]], visits.x.data() + begin, visits.y.data() + begin,
+                          end - begin, dist.data());
+                from = dist.data();
+            }
+            for (int v = begin; v < end; ++v) {
+                if (!model.cancelled[v]) {
+                    Pair pair = { from[v - begin], agent, v };
+                    pairs.push_back(pair);
+                }
+            }
+        }
+        sort(pairs.begin(), pairs.end());
+
+        busy.assign(numAgents, false);
+        done.assign(end - begin, false);
+        for (const Pair& pair : pairs) {
+            if (busy[pair.agent] || done[pair.visit - begin]) {
+                continue;
+            }
+            busy[pair.agent] = true;
+            done[pair.visit - begin] = true;
+            if (last[pair.agent] < 0) {
+                routes.first[pair.agent] = pair.visit;
+            } else {
+                routes.next[last[pair.agent]] = pair.visit;
+            }
+            last[pair.agent] = pair.visit;
+        }
+    }
+
+    return routes;
+}
+
+// Same value as the MIP objective would give for these routes
+double routesCost(const Model& model, const Routes& routes) {
+    double cost = 0;
+    for (int agent = 0; agent < (int) routes.first.size(); ++agent) {
+        const Agent& a = model.agents[agent];
+        int v = routes.first[agent];
+        if (v < 0) {
+            continue;
+        }
+        cost += distance(a.x, a.y, model.visits.x[v], model.visits.y[v]);
+        for (; routes.next[v] >= 0; v = routes.next[v]) {
+            int d = routes.next[v];
+            cost += distance(model.visits.x[v], model.visits.y[v], model.visits.x[d], model.visits.y[d]);
+        }
+        cost += distance(model.visits.x[v], model.visits.y[v], a.x, a.y);
+    }
+    return cost;
+}
+
+// Visitors seen in these routes
+int routesVisitors(const Model& model, const Routes& routes) {
+    int visitors = 0;
+    for (int agent = 0; agent < (int) routes.first.size(); ++agent) {
+        for (int v = routes.first[agent]; v >= 0; v = routes.next[v]) {
+            visitors += model.visits.pool_size[v];
+        }
+    }
+    return visitors;
+}
+
+// Whether routes keep every restriction of the MIP (each visit is done by a single agent by construction)
+bool routesFeasible(const Model& model, const Routes& routes) {
+    map<int, int> done;
+    for (int agent = 0; agent < (int) routes.first.size(); ++agent) {
+        for (int v = routes.first[agent]; v >= 0; v = routes.next[v]) {
+            done[model.visits.slot[v]]++;
+        }
+    }
+    for (auto slotVisits : model.slotVisits) {
+        if (done[slotVisits.first] < slotLowerBound(model, slotVisits.first)) {
+            return false;
+        }
+    }
+    return routesVisitors(model, routes) >= numVisitors95(model);
+}
+
+// Lagrangian decomposition over the slot DAG
+// Relaxing the rows that tie agents together (visit at most once, visits per slot and 95% visitors)
+// with multipliers mu[v], lambda[s], pi >= 0, every agent is left with a shortest path problem:
+// from his house through visits in increasing slots and back, where entering visit v costs
+//     w[v] = mu[v] - lambda[slot of v] - pi * pool_size[v]
+// on top of the distance. Visits are sorted by slot, so one pass over the arcs arriving
+// at each visit solves it. The sum of the paths plus the constants is a lower bound
+// for the MIP, and the multipliers follow subgradient steps towards the best bound.
+// Every iteration the paths are also turned into routes (visits taken by an earlier agent
+// are skipped) to get feasible solutions.
+struct Lagrangian {
+    double lowerBound, upperBound;
+    Routes best;
+};
+
+Lagrangian lagrangianBound(const Model& model, const ArcStore& arcs, const Routes& start, int iterations) {
+    const vector<Agent>& agents = model.agents;
+    const Visits& visits = model.visits;
+    const SlotIndex& slots = model.slots;
+    int numAgents = agents.size();
+    int numVisits = visits.size();
+
+    Lagrangian result;
+    result.lowerBound = -1e100;
+    result.upperBound = routesFeasible(model, start) ? routesCost(model, start) : 1e100;
+    result.best = start;
+
+    vector<double> mu(numVisits, 0), lambda(slots.size(), 0), w(numVisits);
+    double pi = 0;
+    vector<double> best(numVisits);
+    vector<int> pred(numVisits);
+    vector<int> inCount(numVisits);
+    vector<vector<int>> paths(numAgents);
+    vector<double> pathCost(numAgents);
+    double theta = 2;
+    int sinceImproved = 0;
+
+    for (int it = 0; it < iterations; ++it) {
+        for (int v = 0; v < numVisits; ++v) {
+            w[v] = mu[v] - lambda[slots.slotOf[v]] - pi * visits.pool_size[v];
+        }
+
+        // constants of the relaxed rows
+        double bound = pi * numVisitors95(model);
+        for (int v = 0; v < numVisits; ++v) {
+            bound -= mu[v];
+        }
+        for (int s = 0; s < slots.size(); ++s) {
+            bound += lambda[s] * slotLowerBound(model, visits.slot[slots.slotStart[s]]);
+        }
+
+        // one shortest path per agent, empty route included
+        fill(inCount.begin(), inCount.end(), 0);
+        for (int agent = 0; agent < numAgents; ++agent) {
+            const double *home = model.house.data() + agent * numVisits;
+            int end = -1;
+            double endCost = 0;
+            for (int v = 0; v < numVisits; ++v) {
+                if (model.cancelled[v]) {
+                    best[v] = 1e100;
+                    continue;
+                }
+                best[v] = home[v];
+                pred[v] = -1;
+                for (int k = arcs.inStart[v]; k < arcs.inStart[v + 1]; ++k) {
+                    int e = arcs.inArcs[k];
+                    double cost = best[arcs.origin[e]] + arcs.cost[e];
+                    if (cost < best[v]) {
+                        best[v] = cost;
+                        pred[v] = arcs.origin[e];
+                    }
+                }
+                best[v] += w[v];
+                double total = best[v] + home[v];
+                if (total < endCost) {
+                    endCost = total;
+                    end = v;
+                }
+            }
+            bound += endCost;
+            pathCost[agent] = endCost;
+            paths[agent].clear();
+            for (int v = end; v >= 0; v = pred[v]) {
+                paths[agent].push_back(v);
+                inCount[v]++;
+            }
+            reverse(paths[agent].begin(), paths[agent].end());
+        }
+
+        if (bound > result.lowerBound + 1e-9) {
+            result.lowerBound = bound;
+            sinceImproved = 0;
+        } else if (++sinceImproved >= 20) {
+            theta /= 2;
+            sinceImproved = 0;
+        }
+
+        // primal side: cheapest paths first, a visit already taken is skipped
+        vector<int> order(numAgents);
+        for (int agent = 0; agent < numAgents; ++agent) { order[agent] = agent; }
+        sort(order.begin(), order.end(), [&](int x, int y) { return pathCost[x] < pathCost[y]; });
+        Routes routes;
+        routes.first.assign(numAgents, -1);
+        routes.next.assign(numVisits, -1);
+        vector<bool> taken(numVisits, false);
+        for (int agent : order) {
+            int last = -1;
+            for (int v : paths[agent]) {
+                if (taken[v]) {
+                    continue;
+                }
+                taken[v] = true;
+                (last < 0 ? routes.first[agent] : routes.next[last]) = v;
+                last = v;
+            }
+        }
+        if (routesFeasible(model, routes) && routesCost(model, routes) < result.upperBound) {
+            result.upperBound = routesCost(model, routes);
+            result.best = routes;
+        }
+
+        // subgradient step (Polyak), against the best known solution when there is one
+        vector<double> gLambda(slots.size(), 0);
+        double gPi = numVisitors95(model), norm = 0;
+        for (int v = 0; v < numVisits; ++v) {
+            gLambda[slots.slotOf[v]] -= inCount[v];
+            gPi -= inCount[v] * visits.pool_size[v];
+            if (!model.cancelled[v]) {
+                norm += (inCount[v] - 1) * (inCount[v] - 1);
+            }
+        }
+        for (int s = 0; s < slots.size(); ++s) {
+            gLambda[s] += slotLowerBound(model, visits.slot[slots.slotStart[s]]);
+            norm += gLambda[s] * gLambda[s];
+        }
+        norm += gPi * gPi;
+        if (norm < 1e-12 || result.upperBound - result.lowerBound < 1e-6 * max(1.0, fabs(result.upperBound))) {
+            break;
+        }
+        double target = result.upperBound < 1e100 ? result.upperBound : bound + 1 + fabs(bound) * 0.1;
+        double step = theta * (target - bound) / norm;
+        for (int v = 0; v < numVisits; ++v) {
+            mu[v] = max(0.0, mu[v] + step * (inCount[v] - 1));
+        }
+        for (int s = 0; s < slots.size(); ++s) {
+            lambda[s] = max(0.0, lambda[s] + step * gLambda[s]);
+        }
+        pi = max(0.0, pi + step * gPi);
+    }
+
+    return result;
+}
+
+// Seconds since start, which moves to now
+double lap(chrono::steady_clock::time_point& start) {
+    auto now = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(now - start).count();
+    start = now;
+    return seconds;
+}
+
+// Solver to stop on SIGINT / SIGTERM, the routes found so far still get printed.
+// A second signal kills the process as usual
+MIPSolver *runningSolver = NULL;
+
+void cancelSolve(int) {
+    if (runningSolver != NULL) {
+        runningSolver->cancel();
+    }
+}
+
+// Writes the timings and search statistics of the run as JSON, if asked to,
+// along with the cost of the printed routes and the peak memory of the process
+void writeStats(const char *statsFile, const SolveStats& stats, double objective) {
+    if (statsFile != NULL) {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        ofstream out(statsFile);
+        out.precision(12);
+        out << "{\"objective\": " << objective << ", \"peak_memory_kb\": " << usage.ru_maxrss << ", "
+            << stats.json().substr(1) << endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    bool incremental = false;
+    int resolveTimeLimit = 10;
+    double timeLimit = 300; // 5 minutes
+    double gapLimit = 0;
+    double stallLimit = 0;
+    bool stream = false;
+    const char *startFile = NULL;
+    bool heuristicOnly = false;
+    int lagrangianIterations = 0;
+    int nearest = 0;
+    double radius = 0;
+    const char *logFile = "log.txt";
+    const char *settingsFile = NULL;
+    const char *statsFile = NULL;
+    bool lagrangianOnly = false;
+    bool concurrent = false;
+    bool compareSerial = false;
+    const char *cacheDir = NULL;
+    Formulation formulation = AGENT_FORMULATION;
+    ParallelSettings parallel;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--incremental")) {
+            incremental = true;
+        } else if (!strcmp(argv[i], "--resolve-time-limit") && i + 1 < argc) {
+            resolveTimeLimit = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--time-limit") && i + 1 < argc) {
+            timeLimit = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--gap") && i + 1 < argc) {
+            gapLimit = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--stall") && i + 1 < argc) {
+            stallLimit = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--stream")) {
+            stream = true;
+        } else if (!strcmp(argv[i], "--start") && i + 1 < argc) {
+            startFile = argv[++i];
+        } else if (!strcmp(argv[i], "--heuristic-only")) {
+            heuristicOnly = true;
+        } else if (!strcmp(argv[i], "--lagrangian") && i + 1 < argc) {
+            lagrangianIterations = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--lagrangian-only")) {
+            lagrangianOnly = true;
+        } else if (!strcmp(argv[i], "--nearest") && i + 1 < argc) {
+            nearest = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--radius") && i + 1 < argc) {
+            radius = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--log") && i + 1 < argc) {
+            logFile = argv[++i];
+        } else if (!strcmp(argv[i], "--quiet")) {
+            logFile = NULL;
+        } else if (!strcmp(argv[i], "--settings") && i + 1 < argc) {
+            settingsFile = argv[++i];
+        } else if (!strcmp(argv[i], "--stats") && i + 1 < argc) {
+            statsFile = argv[++i];
+        } else if (!strcmp(argv[i], "--concurrent")) {
+            concurrent = true;
+        } else if (!strcmp(argv[i], "--solver-threads") && i + 1 < argc) {
+            parallel.threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            parallel.seed = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--emphasis") && i + 1 < argc) {
+            istringstream list(argv[++i]);
+            string emphasis;
+            while (getline(list, emphasis, ',')) {
+                parallel.emphasis.push_back(emphasis);
+            }
+        } else if (!strcmp(argv[i], "--deterministic")) {
+            parallel.deterministic = true;
+        } else if (!strcmp(argv[i], "--compare-serial")) {
+            compareSerial = true;
+        } else if (!strcmp(argv[i], "--cache") && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (!strcmp(argv[i], "--model") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "agents")) {
+                formulation = AGENT_FORMULATION;
+            } else if (!strcmp(argv[i], "flow")) {
+                formulation = FLOW_FORMULATION;
+            } else if (!strcmp(argv[i], "routes")) {
+                formulation = ROUTE_FORMULATION;
+            } else {
+                cerr << "Unknown model " << argv[i] << endl;
+                return 1;
+            }
+        } else {
+            cerr << "usage: " << argv[0] << " [--log file | --quiet] [--heuristic-only] [--nearest k] [--radius r] [--lagrangian iterations [--lagrangian-only]] [--start routes.txt] [--model agents|flow|routes]"
+                 << " [--time-limit seconds] [--gap g] [--stall seconds] [--stream]"
+                 << " [--incremental [--resolve-time-limit seconds]] [--settings file.set] [--stats file.json] [--cache dir]"
+                 << " [--concurrent [--solver-threads n] [--seed n] [--emphasis e1,e2,...] [--deterministic] [--compare-serial]] < input" << endl;
+            return 1;
+        }
+    }
+    if (incremental && formulation != AGENT_FORMULATION) {
+        cerr << "--incremental needs the agents model" << endl;
+        return 1;
+    }
+    if (concurrent && formulation == ROUTE_FORMULATION) {
+        cerr << "--concurrent can't generate routes, use another model" << endl;
+        return 1;
+    }
+
+    int index = 0;
+    int numAgents;
+    int numVisits;
+    double x, y;
+    int slot, pool_size;
+
+    Model model;
+    vector<Agent>& agents = model.agents;
+    Visits& visits = model.visits;
+
+    // phases of the run before the MIP, they go to the MIP stats once it exists
+    SolveStats timing;
+    auto phaseStart = chrono::steady_clock::now();
+
+    // stdin is mapped when it is a file and read in blocks otherwise,
+    // the incremental commands come from the same reader
+    Reader input;
+    numAgents = input.integer("the number of agents");
+    agents.reserve(max(numAgents, 0));
+
+    for (int i = 0; i < numAgents && input.ok(); ++i) {
+        x = input.number("agent x");
+        y = input.number("agent y");
+        agents.push_back(Agent(index++, x, y));
+    }
+
+    numVisits = input.integer("the number of visits");
+    visits.reserve(max(numVisits, 0));
+
+    for (int i = 0; i < numVisits && input.ok(); ++i) {
+        slot = input.integer("visit slot");
+        x = input.number("visit x");
+        y = input.number("visit y");
+        pool_size = input.integer("visit pool size");
+        visits.push_back(Visit(index++, slot, pool_size, x, y));
+    }
+    if (!input.ok()) {
+        cerr << "Bad input, " << input.error() << endl;
+        return 1;
+    }
+    timing.add_phase("parsing", lap(phaseStart));
+
+    if(DEBUG) { printData(agents, visits); }
+
+    // from here on visits are sorted by slot, visit v is the v-th one in this order
+    // (relative_index still tells which visit it was in the input)
+    model.slots = buildSlotIndex(visits);
+    model.cancelled.assign(numVisits, false);
+    model.totalNumVisitors = 0;
+    for (int v = 0; v < visits.size(); ++v) {
+        model.slotVisits[visits.slot[v]]++;
+        model.totalNumVisitors += visits.pool_size[v];
+    }
+
+    if(DEBUG) { printSlots(visits, model.slots); }
+    timing.add_phase("slots", lap(phaseStart));
+
+    // Routes of an earlier run on the same input: optimal ones are the answer (unless the model
+    // is needed for --incremental), others are one more starting solution
+    unique_ptr<ResultCache> cache;
+    string key;
+    Routes cached;
+    bool cachedOptimal = false;
+    bool cachedFound = false;
+    if (cacheDir != NULL) {
+        cache.reset(new ResultCache(cacheDir));
+        key = cacheKey(model, nearest, radius);
+        cachedFound = loadRoutes(*cache, key, model, cached, cachedOptimal) && routesFeasible(model, cached);
+        timing.add_phase("cache", lap(phaseStart));
+        if (cachedFound) {
+            cout << "::::: Cached routes: objective " << routesCost(model, cached) << (cachedOptimal ? " (optimal)" : "") << endl;
+        }
+        if (cachedFound && cachedOptimal && !incremental) {
+            printRoutes(model, cached);
+            writeStats(statsFile, timing, routesCost(model, cached));
+            return 0;
+        }
+    }
+
+    buildHouseDistances(model);
+    timing.add_phase("distances", lap(phaseStart));
+
+    // Greedy routes first, they are the answer in --heuristic-only mode and the MIP start otherwise
+    auto greedyStart = chrono::steady_clock::now();
+    Routes greedy = greedyRoutes(model);
+    double greedyMs = chrono::duration<double, milli>(chrono::steady_clock::now() - greedyStart).count();
+    int greedyVisitors = routesVisitors(model, greedy);
+    bool greedyFeasible = routesFeasible(model, greedy);
+    timing.add_phase("greedy", lap(phaseStart));
+
+    cout << "::::: Greedy heuristic: objective " << routesCost(model, greedy) << ", " << greedyVisitors << " of " << model.totalNumVisitors
+         << " visitors (" << (greedyFeasible ? "feasible" : "infeasible") << "), " << greedyMs << " ms" << endl;
+    if (cachedFound && (!greedyFeasible || routesCost(model, cached) < routesCost(model, greedy))) {
+        greedy = cached;
+        greedyFeasible = true;
+    }
+
+    if (heuristicOnly) {
+        printRoutes(model, greedy);
+        writeStats(statsFile, timing, routesCost(model, greedy));
+        return 0;
+    }
+
+    // Arcs between visits, all of them or only the close ones
+    // pruning needs a feasible schedule whose arcs are kept, as the proof that it did not cut off
+    // feasibility; without one every arc is kept
+    if (nearest > 0 || radius > 0) {
+        if (greedyFeasible) {
+            model.arcs = buildPrunedArcStore(visits, model.slots, nearest, radius, greedy);
+        } else if(DEBUG) {
+            cout << "::::: No feasible schedule to prove the pruning safe, keeping every arc" << endl;
+        }
+    }
+    if (model.arcs.outStart.empty()) {
+        model.arcs = buildArcStore(visits, model.slots);
+    }
+    if(DEBUG) { cout << "::::: Arcs between visits: " << model.arcs.size() << endl; }
+    timing.add_phase("arcs", lap(phaseStart));
+
+    // Lagrangian bound over the slot DAG, without building the MIP
+    // when the gap closes (or with --lagrangian-only) SCIP is not needed at all,
+    // otherwise its best routes are the MIP start and its bound the root bound of the solve
+    // (the arcs are the ones the MIP has, so it holds for every formulation)
+    double lowerBound = -1e100;
+    if (lagrangianIterations > 0) {
+        auto lagrangianStart = chrono::steady_clock::now();
+        Lagrangian lagrangian = lagrangianBound(model, model.arcs, greedy, lagrangianIterations);
+        double lagrangianMs = chrono::duration<double, milli>(chrono::steady_clock::now() - lagrangianStart).count();
+        bool closed = lagrangian.upperBound - lagrangian.lowerBound < 1e-6 * max(1.0, fabs(lagrangian.upperBound));
+
+        cout << "::::: Lagrangian: lower bound " << lagrangian.lowerBound << ", best routes ";
+        if (lagrangian.upperBound < 1e100) {
+            cout << lagrangian.upperBound << (closed ? " (optimal)" : "");
+        } else {
+            cout << "none feasible";
+        }
+        cout << ", " << lagrangianMs << " ms" << endl;
+
+        timing.add_phase("lagrangian", lap(phaseStart));
+        if (closed && cache && lagrangian.upperBound < 1e100) {
+            storeRoutes(*cache, key, lagrangian.best, true);
+        }
+        if (closed || lagrangianOnly) {
+            printRoutes(model, lagrangian.best);
+            writeStats(statsFile, timing, lagrangian.upperBound);
+            return 0;
+        }
+        if (lagrangian.upperBound < 1e100) {
+            greedy = lagrangian.best;
+            greedyFeasible = true;
+        }
+        lowerBound = lagrangian.lowerBound;
+    }
+
+    Routes startRoutes;
+    if (startFile != NULL) {
+        ifstream start(startFile);
+        if (!start) {
+            cerr << "Cannot read " << startFile << endl;
+            return 1;
+        }
+        startRoutes = readStartRoutes(start, model);
+    }
+
+    // Builds the model with its starting solutions in a solver
+    RoutePricer pricer(model);
+    auto addStartRoutes = [&](MIPSolver& mip, const Routes& routes, bool partial) {
+        return formulation == ROUTE_FORMULATION ? addRouteStart(mip, model, routes, partial) : addStart(mip, model, routes, partial);
+    };
+    auto prepare = [&](MIPSolver& mip) {
+        if (settingsFile != NULL) {
+            mip.read_settings(settingsFile);
+        }
+        mip.set_parallel(parallel);
+        mip.keep_rows(incremental);
+        if (formulation == FLOW_FORMULATION) {
+            buildFlowModel(mip, model);
+        } else if (formulation == ROUTE_FORMULATION) {
+            buildRouteMaster(mip, model, pricer);
+        } else {
+            buildModel(mip, model);
+        }
+
+        // Start from routes of a previous run, SCIP completes whatever is missing
+        if (startFile != NULL) {
+            bool stored = addStartRoutes(mip, startRoutes, true);
+            if(DEBUG) { cout << "::::: Routes from " << startFile << (stored ? " accepted" : " rejected") << " as starting solution" << endl; }
+        }
+        if (greedyFeasible) {
+            addStartRoutes(mip, greedy, false);
+        }
+        mip.set_time_limit(timeLimit);
+        if (gapLimit > 0) {
+            mip.set_gap_limit(gapLimit);
+        }
+        mip.set_stall_limit(stallLimit);
+        if (lowerBound > -1e100) {
+            mip.set_lower_bound(lowerBound);
+        }
+    };
+
+    // With --compare-serial the same model is first solved serially on a solver of its own,
+    // so the concurrent solve does not start from its solutions. It is built before the main
+    // solver's, which then leaves model with variables and rows of the solver that is read
+    double serialSeconds = 0;
+    if (concurrent && compareSerial) {
+        MIPSolver serial(NULL);
+        prepare(serial);
+        auto serialStart = chrono::steady_clock::now();
+        serial.solve();
+        serialSeconds = chrono::duration<double>(chrono::steady_clock::now() - serialStart).count();
+    }
+
+    MIPSolver mip(logFile);
+    for (auto& phase : timing.phases) {
+        mip.stats().add_phase(phase.first, phase.second);
+    }
+    prepare(mip); // timed by the solver as its build phase
+    mip.end_build();
+
+    // Every better solution is reported as soon as SCIP finds it, with its routes under --stream,
+    // so a caller can act on a good enough schedule without waiting for the solve to end
+    mip.on_incumbent([&](const Incumbent& incumbent) {
+        cout << "::::: Incumbent objective " << incumbent.objective << ", gap " << incumbent.gap
+             << ", " << incumbent.seconds << " s" << endl;
+        if (stream) {
+            printRoutes(model, readRoutes(incumbent.solution, model));
+        }
+    });
+    runningSolver = &mip;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = cancelSolve;
+    action.sa_flags = SA_RESETHAND;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Solve and print
+    auto solveStart = chrono::steady_clock::now();
+    Routes routes = readRoutes(concurrent ? mip.parallel_solve() : mip.solve(), model);
+    double solveSeconds = chrono::duration<double>(chrono::steady_clock::now() - solveStart).count();
+    if (concurrent && compareSerial) {
+        cout << "::::: Serial solve " << serialSeconds << " s, concurrent solve " << solveSeconds << " s, speedup "
+             << serialSeconds / max(solveSeconds, 1e-9) << endl;
+    }
+    printRoutes(model, routes);
+    if (cache && routesFeasible(model, routes) &&
+        (!cachedFound || mip.stats().status == "optimal" || routesCost(model, routes) < routesCost(model, cached))) {
+        storeRoutes(*cache, key, routes, mip.stats().status == "optimal");
+    }
+
+    if (!incremental) {
+        writeStats(statsFile, mip.stats(), routesCost(model, routes));
+        return 0;
+    }
+
+    // Incremental mode, the model is changed in place after the first solve
+    // and every re-solve starts from the last routes (minus the cancelled visits)
+    //     add <slot> <x> <y> <pool_size>  -> new visit, numbered after the last one
+    //     cancel <visit>                  -> visit won't happen anymore
+    //     solve                           -> re-solve and print the routes
+    mip.set_time_limit(resolveTimeLimit);
+    string line;
+    int number;
+    input.line(&line); // rest of the last visit line
+    while (input.line(&line)) {
+        istringstream in(line);
+        string command;
+        if (!(in >> command)) {
+            continue;
+        }
+        if (command == "add" && in >> slot >> x >> y >> pool_size) {
+            addVisit(mip, model, Visit(index++, slot, pool_size, x, y));
+            if(DEBUG) { cout << "::::: Added visit " << index - 1 - numAgents << endl; }
+        } else if (command == "cancel" && in >> number) {
+            for (int v = 0; v < (int) visits.size(); ++v) {
+                if (visits.relative_index[v] == numAgents + number) {
+                    cancelVisit(mip, model, v);
+                    if(DEBUG) { cout << "::::: Cancelled visit " << number << endl; }
+                }
+            }
+        } else if (command == "solve") {
+            repairRoutes(model, routes);
+            bool started = addStart(mip, model, routes, false);
+            if(DEBUG) { cout << "::::: Previous routes " << (started ? "accepted" : "rejected") << " as starting solution" << endl; }
+            routes = readRoutes(concurrent ? mip.parallel_solve() : mip.solve(), model);
+            printRoutes(model, routes);
+        } else {
+            cerr << "Unknown command: " << line << endl;
+        }
+    }
+    writeStats(statsFile, mip.stats(), routesCost(model, routes));
 }
@@ -0,0 +1,85 @@
+// Generates an agents instance: agents houses and visits spread over the slots,
+// uniformly over a square or in clusters around random centers. While visits fit in
+// agents * slots no slot gets more visits than there are agents, so every visit can be done.
+//     agents-gen [--agents n] [--visits n] [--slots n] [--pool n] [--size s]
+//                [--clusters k] [--seed s] > instance.txt
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    int agents = 4, visits = 40, slots = 10, pool = 3, clusters = 0;
+    double size = 100;
+    unsigned seed = 1;
+    bool usage = false;
+    for (int i = 1; i < argc && !usage; i++) {
+        if (!strcmp(argv[i], "--agents") && i + 1 < argc) {
+            agents = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--visits") && i + 1 < argc) {
+            visits = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--slots") && i + 1 < argc) {
+            slots = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--pool") && i + 1 < argc) {
+            pool = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--size") && i + 1 < argc) {
+            size = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--clusters") && i + 1 < argc) {
+            clusters = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = atoi(argv[++i]);
+        } else {
+            usage = true;
+        }
+    }
+    if (usage || agents <= 0 || visits <= 0 || slots <= 0) {
+        cerr << "usage: " << argv[0] << " [--agents n] [--visits n] [--slots n] [--pool max visitors per visit]"
+             << " [--size half side of the square] [--clusters k (0 for uniform)] [--seed s]" << endl;
+        return 1;
+    }
+
+    mt19937 random(seed);
+    uniform_real_distribution<double> coordinate(-size, size);
+    uniform_int_distribution<int> slot(0, slots - 1), visitors(1, max(1, pool));
+
+    // clusters get a center each and visits a normal spread around one of them
+    vector<double> cx, cy;
+    for (int c = 0; c < clusters; c++) {
+        cx.push_back(coordinate(random));
+        cy.push_back(coordinate(random));
+    }
+    uniform_int_distribution<int> cluster(0, max(0, clusters - 1));
+    normal_distribution<double> spread(0, size / 10);
+
+    cout.precision(12);
+    cout << agents << endl;
+    for (int a = 0; a < agents; a++) {
+        double x = coordinate(random);
+        double y = coordinate(random);
+        cout << x << " " << y << endl;
+    }
+    cout << visits << endl;
+    vector<int> load(max(0, slots), 0);
+    bool capped = (long long)agents * slots >= visits;
+    for (int v = 0; v < visits; v++) {
+        double x, y;
+        if (clusters > 0) {
+            int c = cluster(random);
+            x = cx[c] + spread(random);
+            y = cy[c] + spread(random);
+        } else {
+            x = coordinate(random);
+            y = coordinate(random);
+        }
+        int s = slot(random);
+        while (capped && load[s] >= agents) {
+            s = slot(random);
+        }
+        load[s]++;
+        int visitorCount = visitors(random);
+        cout << s << " " << x << " " << y << " " << visitorCount << endl;
+    }
+}
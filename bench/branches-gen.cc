@@ -0,0 +1,133 @@
+// Generates a branches board with at least one solution: cells are visited in random order
+// and every free one becomes a number whose arms grow at random over free cells
+// (up to 9 cells), the number being how many cells its arms took. A cell walled in before
+// it could grow any arm joins or takes the tip of a neighbouring arm, so every number is
+// at least 1.
+//     branches-gen [--width w] [--height h] [--seed s] > board.txt
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+int main(int argc, char **argv) {
+    int w = 10, h = 10;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--width") && i + 1 < argc) {
+            w = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--height") && i + 1 < argc) {
+            h = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = atoi(argv[++i]);
+        } else {
+            cerr << "usage: " << argv[0] << " [--width w] [--height h] [--seed s]" << endl;
+            return 1;
+        }
+    }
+
+    static const int dx[] = {1, -1, 0, 0};
+    static const int dy[] = {0, 0, 1, -1};
+    mt19937 random(seed);
+    uniform_int_distribution<int> target(1, 9), direction(0, 3);
+    struct Group {
+        int i, j, value;
+        int length[4];
+    };
+    vector<Group> groups;
+    vector<string> board;
+
+    // a board whose last free cell is walled in by arms that can't reach it is drawn again
+    for (bool complete = false; !complete;) {
+        complete = true;
+        groups.clear();
+        board.assign(h, string(w, '.'));
+        vector<vector<int>> owner(h, vector<int>(w, -1));
+        vector<int> order(w * h);
+        for (int c = 0; c < w * h; c++) {
+            order[c] = c;
+        }
+        shuffle(order.begin(), order.end(), random);
+
+        for (int c : order) {
+            int i = c % w, j = c / w;
+            if (owner[j][i] >= 0) {
+                continue;
+            }
+
+            // grow one arm tip at a time until the target is met or no arm can grow
+            Group g = {i, j, 0, {0, 0, 0, 0}};
+            int want = target(random);
+            bool blocked[4] = {false, false, false, false};
+            owner[j][i] = groups.size();
+            while (g.value < want && !(blocked[0] && blocked[1] && blocked[2] && blocked[3])) {
+                int d = direction(random);
+                int ii = i + dx[d] * (g.length[d] + 1), jj = j + dy[d] * (g.length[d] + 1);
+                if (ii < 0 || ii >= w || jj < 0 || jj >= h || owner[jj][ii] >= 0) {
+                    blocked[d] = true;
+                    continue;
+                }
+                owner[jj][ii] = groups.size();
+                g.length[d]++;
+                g.value++;
+            }
+            if (g.value > 0) {
+                groups.push_back(g);
+                continue;
+            }
+
+            // a number needs at least one cell: hand the walled in cell to a neighbouring arm
+            // whose tip touches it instead (directions 0/1 and 2/3 are opposite)
+            bool absorbed = false;
+            for (int d = 0; d < 4 && !absorbed; d++) {
+                int ii = i + dx[d], jj = j + dy[d], e = d ^ 1;
+                if (ii < 0 || ii >= w || jj < 0 || jj >= h) {
+                    continue;
+                }
+                Group &n = groups[owner[jj][ii]];
+                if (n.value < 9 && n.i + dx[e] * n.length[e] == ii && n.j + dy[e] * n.length[e] == jj) {
+                    owner[j][i] = owner[jj][ii];
+                    n.length[e]++;
+                    n.value++;
+                    absorbed = true;
+                }
+            }
+            // or let it take over the tip of a neighbouring arm whose number can spare a cell
+            for (int d = 0; d < 4 && !absorbed; d++) {
+                int ii = i + dx[d], jj = j + dy[d];
+                if (ii < 0 || ii >= w || jj < 0 || jj >= h) {
+                    continue;
+                }
+                Group &n = groups[owner[jj][ii]];
+                for (int e = 0; e < 4 && !absorbed; e++) {
+                    if (n.value > 1 && n.length[e] > 0 && n.i + dx[e] * n.length[e] == ii &&
+                        n.j + dy[e] * n.length[e] == jj) {
+                        n.length[e]--;
+                        n.value--;
+                        owner[jj][ii] = groups.size();
+                        g.length[d] = 1;
+                        g.value = 1;
+                        groups.push_back(g);
+                        absorbed = true;
+                    }
+                }
+            }
+            if (!absorbed) {
+                complete = false;
+                break;
+            }
+        }
+    }
+    for (const Group &g : groups) {
+        board[g.j][g.i] = '0' + g.value;
+    }
+
+    cout << w << " " << h << " " << groups.size() << endl;
+    for (int j = 0; j < h; j++) {
+        cout << board[j] << endl;
+    }
+}
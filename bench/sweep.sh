@@ -0,0 +1,57 @@
+#!/bin/sh
+# Runs agents and branches over generated instances of growing size and appends
+# one JSON line per run to $OUT: the program, the instance parameters, the seed,
+# the wall time in seconds and the --stats output of the run (phase timings,
+# search statistics, peak memory and, for agents, the objective).
+#     bench/sweep.sh                       (from the repository root, after make)
+#     SEEDS="1 2" AGENT_SIZES="4:40:10" BOARD_SIZES="10 20" bench/sweep.sh
+# Sizes are agents:visits:slots triples for agents and board sides for branches;
+# agents * slots should be at least visits or the instance can't reach its 95% of visitors.
+# AGENTS_FLAGS and BRANCHES_FLAGS are passed to the solvers.
+set -e
+
+OUT=${OUT:-benchmark.jsonl}
+SEEDS=${SEEDS:-"1 2 3"}
+AGENT_SIZES=${AGENT_SIZES:-"2:10:6 4:30:10 8:100:16"}
+BOARD_SIZES=${BOARD_SIZES:-"10 20 40"}
+CLUSTERS=${CLUSTERS:-0}
+
+instance=$(mktemp)
+stats=$(mktemp)
+trap 'rm -f "$instance" "$stats"' EXIT
+
+now() {
+    date +%s%N
+}
+
+# record program parameters seed start
+record() {
+    end=$(now)
+    wall=$(( (end - $4) / 1000000 ))
+    printf '{"program": "%s", %s, "seed": %s, "wall": %d.%03d, "stats": %s}\n' \
+        "$1" "$2" "$3" $((wall / 1000)) $((wall % 1000)) "$(cat "$stats")" >> "$OUT"
+}
+
+for seed in $SEEDS; do
+    for size in $AGENT_SIZES; do
+        agents=${size%%:*}
+        rest=${size#*:}
+        visits=${rest%%:*}
+        slots=${rest#*:}
+        bench/agents-gen --agents "$agents" --visits "$visits" --slots "$slots" --clusters "$CLUSTERS" \
+            --seed "$seed" > "$instance"
+        echo "{}" > "$stats"
+        start=$(now)
+        ./agents --quiet --stats "$stats" $AGENTS_FLAGS < "$instance" > /dev/null || true
+        record agents "\"agents\": $agents, \"visits\": $visits, \"slots\": $slots, \"clusters\": $CLUSTERS" \
+            "$seed" "$start"
+    done
+    for side in $BOARD_SIZES; do
+        bench/branches-gen --width "$side" --height "$side" --seed "$seed" > "$instance"
+        echo "{}" > "$stats"
+        start=$(now)
+        ./branches --quiet --stats "$stats" $BRANCHES_FLAGS < "$instance" > /dev/null || true
+        record branches "\"width\": $side, \"height\": $side" "$seed" "$start"
+    done
+done
+echo "Results appended to $OUT"
@@ -1,5 +1,17 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <sys/resource.h>
 #include "easyscip/easyscip.h"
+#include "easyscip/cache.h"
+#include "easyscip/parallel.h"
+#include "easyscip/reader.h"
 
 using namespace std;
 using namespace easyscip;
@@ -8,184 +20,1111 @@ bool valid(int i, int j, int w, int h) {
   return i >= 0 && i < w && j >= 0 && j < h;
 }
 
-int main() {
-    int w,h,g; // width, height, number of groups
-    cin >> w >> h >> g;
+struct Board {
+    int w, h, g; // width, height, number of groups
+    string cells; // row by row, cell (i, j) is cells[j * w + i]
 
-    vector<string> board(h);
-    for (int i = 0; i < h; i++) {
-        cin >> board[i];
+    char at(int i, int j) const { return cells[j * w + i]; }
+};
+
+// directions: right, left, down, up
+static const int dx[] = {1, -1, 0, 0};
+static const int dy[] = {0, 0, 1, -1};
+static const char arrow[] = {'>', '<', 'v', '^'};
+
+// numbers of the board, in reading order
+struct Groups {
+    vector<int> value, i, j;
+};
+
+// Which solver handles a board: propagation falling back to the MIP, only propagation or only the MIP
+enum Engine {AUTO_ENGINE, PROPAGATION_ENGINE, MIP_ENGINE};
+
+// MIP model: a binary per cell an arm can cover, or an integer length per arm (its covers follow from it)
+enum Formulation {CELL_FORMULATION, ARM_FORMULATION};
+
+// Timings of a board and the stats of every MIP solved for it (see MIPSolver::stats), kept with --stats
+struct StatsLog {
+    mutex lock;
+    vector<pair<string, double>> phases;
+    vector<string> mips;
+
+    void addPhase(const string& name, double seconds) {
+        lock_guard<mutex> guard(lock);
+        phases.push_back(make_pair(name, seconds));
+    }
+    string json() {
+        lock_guard<mutex> guard(lock);
+        ostringstream out;
+        out << "{\"phases\": {";
+        for (int i = 0; i < (int) phases.size(); i++) {
+            out << (i ? ", " : "") << "\"" << phases[i].first << "\": " << phases[i].second;
+        }
+        out << "}, \"mips\": [";
+        for (int i = 0; i < (int) mips.size(); i++) {
+            out << (i ? ", " : "") << mips[i];
+        }
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        out << "], \"peak_memory_kb\": " << usage.ru_maxrss << "}";
+        return out.str();
     }
+};
 
-    // groups values and pos
-    vector<int> groupValue;
-    vector<int> groupi;
-    vector<int> groupj;
+// How boards are solved, set from the command line
+struct Options {
+    Engine engine;
+    Formulation formulation;
+    long nodeLimit;
+    bool decompose;     // solve the independent parts of a board as separate MIPs
+    int threads;        // for the parts of one board
+    bool concurrent;    // each MIP with MIPSolver::parallel_solve
+    bool compareSerial; // also solve each MIP serially and report the speedup
+    ParallelSettings parallel;
+    string settings;    // SCIP .set file for every MIP
+    StatsLog *stats;    // where to keep the stats, if anywhere
+    ResultCache *cache; // drawings of boards solved before, if any
+    Options() : engine(AUTO_ENGINE), formulation(CELL_FORMULATION), nodeLimit(100000), decompose(true),
+                threads(default_threads()), concurrent(false), compareSerial(false),
+                stats(NULL), cache(NULL) {}
+};
 
-    groupValue.reserve(g);
-    groupi.reserve(g);
-    groupj.reserve(g);
+// Reads the next board, false at the end of the input or when the board is malformed (see in.ok())
+bool readBoard(Reader& in, Board& b) {
+    if (in.at_end()) {
+        return false;
+    }
+    b.w = in.integer("the board width");
+    b.h = in.integer("the board height");
+    if (in.ok() && (b.w <= 0 || b.h <= 0)) {
+        in.reject("a positive board size");
+    }
+    b.g = in.integer("the number of groups");
+    if (in.ok() && b.g < 0) {
+        in.reject("a non-negative number of groups");
+    }
+    b.cells.clear();
+    for (int j = 0; j < b.h && in.ok(); j++) {
+        const char *begin, *end;
+        if (!in.word(&begin, &end, "a board row")) {
+            break;
+        }
+        if (end - begin != b.w) {
+            in.reject("a board row as long as the width");
+        }
+        // single digits keep every arm length within the propagator's 16 bit domains
+        for (const char *c = begin; c < end && in.ok(); c++) {
+            if (*c != '.' && (*c < '0' || *c > '9')) {
+                in.reject("a board row of dots and digits");
+            }
+        }
+        b.cells.append(begin, end);
+    }
+    return in.ok();
+}
 
-    // Get groups values
-    for (int j = 0; j < h; j++) {
-        for (int i = 0; i < w; i++) {
-            if (board[j][i] != '.') { // -> if not a dot then is a group, a number
-                int value = board[j][i] - '0';
-                groupValue.push_back(value); // char to int
-                groupj.push_back(j);
-                groupi.push_back(i);
+Groups findGroups(const Board& b) {
+    Groups groups;
+    groups.value.reserve(b.g);
+    groups.i.reserve(b.g);
+    groups.j.reserve(b.g);
+    for (int j = 0; j < b.h; j++) {
+        for (int i = 0; i < b.w; i++) {
+            if (b.at(i, j) != '.') { // -> if not a dot then is a group, a number
+                groups.value.push_back(b.at(i, j) - '0'); // char to int
+                groups.j.push_back(j);
+                groups.i.push_back(i);
             }
         }
     }
+    return groups;
+}
 
-    MIPSolver mip;
+// How many cells the arm of group k can take in direction d (until a wall, another number or its value)
+int reach(const Board& b, const Groups& groups, int k, int d) {
+    int ii = groups.i[k] + dx[d], jj = groups.j[k] + dy[d];
+    int step = 0;
+    while (valid(ii, jj, b.w, b.h) && b.at(ii, jj) == '.' && step < groups.value[k]) {
+        ii += dx[d];
+        jj += dy[d];
+        step++;
+    }
+    return step;
+}
 
-    // 3d solver branches[i][j][g] = if there is a branch on board i,j considering group g
-    vector<vector<vector<Variable>>> branches(h, vector<vector<Variable>>(w));
-    for (int j = 0; j < h; j++) {
-        for (int i = 0; i < w; i++) {
-            for (int k = 0; k < g; k++) {
-                if (i != groupi[k] && j != groupj[k]) {
-                    branches[j][i].push_back(NullVariable());
-                } else {
-                    branches[j][i].push_back(mip.binary_variable(1));
-                }
+// Drawing of the board given the length of every arm, arms[4 * k + d] for group k and direction d
+string drawArms(const Board& b, const Groups& groups, const vector<int>& arms) {
+    string out = b.cells;
+    for (int k = 0; k < (int) groups.value.size(); k++) {
+        for (int d = 0; d < 4; d++) {
+            int length = arms[4 * k + d];
+            for (int t = 1; t <= length; t++) {
+                out[(groups.j[k] + dy[d] * t) * b.w + groups.i[k] + dx[d] * t] = t == length ? arrow[d] : (dx[d] ? '-' : '|');
             }
         }
     }
+    string drawing;
+    drawing.reserve((b.w + 1) * b.h);
+    for (int j = 0; j < b.h; j++) {
+        drawing.append(out, j * b.w, b.w);
+        drawing += '\n';
+    }
+    return drawing;
+}
 
-    // Restrictions considering complete board and groups
-    for (int j = 0; j < h; j++) {
-        for (int i = 0; i < w; i++) {
-            if (board[j][i] == '.') {
-                auto cons = mip.constraint();
-                for (int k = 0; k < g; k++) {
-                    cons.add_variable(branches[j][i][k], 1);
+// Whether the drawing solves the board: numbers are in place, every arm is a straight run ending in
+// its arrow, no cell is taken twice, every free cell is taken and every number gets its value
+bool validDrawing(const Board& b, const string& drawing) {
+    if ((int) drawing.size() != (b.w + 1) * b.h) {
+        return false;
+    }
+    vector<bool> taken(b.w * b.h, false);
+    int free = 0, covered = 0;
+    for (int j = 0; j < b.h; j++) {
+        if (drawing[j * (b.w + 1) + b.w] != '\n') {
+            return false;
+        }
+        for (int i = 0; i < b.w; i++) {
+            if (b.at(i, j) == '.') {
+                free++;
+                continue;
+            }
+            if (drawing[j * (b.w + 1) + i] != b.at(i, j)) {
+                return false;
+            }
+            int total = 0;
+            for (int d = 0; d < 4; d++) {
+                int ii = i + dx[d], jj = j + dy[d];
+                for (int t = 1; valid(ii, jj, b.w, b.h) && b.at(ii, jj) == '.'; t++) {
+                    char c = drawing[jj * (b.w + 1) + ii];
+                    if (c != arrow[d] && c != (dx[d] ? '-' : '|')) {
+                        break;
+                    }
+                    if (taken[jj * b.w + ii]) {
+                        return false;
+                    }
+                    taken[jj * b.w + ii] = true;
+                    total++;
+                    if (c == arrow[d]) {
+                        break;
+                    }
+                    ii += dx[d];
+                    jj += dy[d];
                 }
-                cons.commit(1, 1);
             }
+            if (total != b.at(i, j) - '0') {
+                return false;
+            }
+            covered += total;
+        }
+    }
+    return covered == free;
+}
+
+// Serial or concurrent solve, as the options say
+Solution solveMIP(MIPSolver& mip, const Options& options) {
+    if (!options.settings.empty()) {
+        mip.read_settings(options.settings);
+    }
+    if (!options.concurrent) {
+        return mip.solve();
+    }
+    mip.set_parallel(options.parallel);
+    return mip.parallel_solve();
+}
+
+// Part of a board to solve as a MIP: its groups (indexes into Groups), how long each of their arms can be
+// (4 per member) and the cells they must cover, each exactly once
+struct Part {
+    vector<int> members, limit, cells;
+};
+
+Part wholeBoard(const Board& b, const Groups& groups) {
+    Part part;
+    for (int a = 0; a < (int) groups.value.size(); a++) {
+        part.members.push_back(a);
+        for (int k = 0; k < 4; k++) {
+            part.limit.push_back(reach(b, groups, a, k));
+        }
+    }
+    for (int c = 0; c < b.w * b.h; c++) {
+        if (b.cells[c] == '.') {
+            part.cells.push_back(c);
+        }
+    }
+    return part;
+}
+
+// Cell formulation: builds the model of the part in mip (which must be empty), solves it and returns the arms
+// of its members
+vector<int> solveCellModel(MIPSolver& mip, const Board& b, const Groups& groups, const Part& part, const Options& options) {
+    int w = b.w, h = b.h, g = part.members.size();
+
+    // branches[armStart[4 * a + k] + step - 1] = if the arm of member a in direction k covers its step-th cell,
+    // only for the cells it can reach (before a wall, another group or its value)
+    vector<int> armStart(4 * g + 1, 0);
+    for (int a = 0; a < 4 * g; a++) {
+        armStart[a + 1] = armStart[a] + part.limit[a];
+    }
+    vector<Variable> branches;
+    branches.reserve(armStart[4 * g]);
+    for (int v = 0; v < armStart[4 * g]; v++) {
+        branches.push_back(mip.binary_variable(1));
+    }
+
+    // candidates[4 * (j * w + i) + k] = branch of the group that reaches cell i,j going in direction k
+    // (the nearest group in the opposite direction), if any
+    vector<Variable> candidates(4 * w * h, NullVariable());
+    for (int a = 0; a < g; a++) {
+        int group = part.members[a];
+        for (int k = 0; k < 4; k++) {
+            for (int step = 1; step <= part.limit[4 * a + k]; step++) {
+                int c = (groups.j[group] + dy[k] * step) * w + groups.i[group] + dx[k] * step;
+                candidates[4 * c + k] = branches[armStart[4 * a + k] + step - 1];
+            }
+        }
+    }
+
+    // Restrictions considering complete board and groups
+    for (int c : part.cells) {
+        auto cons = mip.constraint();
+        for (int k = 0; k < 4; k++) {
+            cons.add_variable(candidates[4 * c + k], 1);
         }
+        cons.commit(1, 1);
     }
 
     // Restrictions considering total value of group
-    static int dx[] = {1, -1, 0, 0};
-    static int dy[] = {0, 0, 1, -1};
     for (int a = 0; a < g; a++) {
         auto cons = mip.constraint(); // for each group
-        int i = groupi[a];
-        int j = groupj[a];
+        for (int v = armStart[4 * a]; v < armStart[4 * a + 4]; v++) {
+            cons.add_variable(branches[v], 1);
+        }
+        int value = groups.value[part.members[a]];
+        cons.commit(value, value);
+    }
 
-        for (int k = 0; k < 4; k++) {
-            int jj = j + dy[k], ii = i + dx[k];
-            int step = 0;
-            while (valid(ii, jj, w, h) && board[jj][ii] == '.' && step < groupValue[a]) {
-                cons.add_variable(branches[jj][ii][a], 1);
-                ii += dx[k];
-                jj += dy[k];
-                step++;
+    // For each group we iterate line and column (until wall or another group)
+    // and each step makes a new constraint: a branch needs all the branches before it
+
+    // iterate through arms
+    for (int a = 0; a < 4 * g; a++) {
+        const Variable *arm = &branches[armStart[a]];
+        int step = part.limit[a];
+
+        // lets walk back from the last possible step
+        while (step > 1) {
+            auto cons = mip.constraint();
+            cons.add_variable(arm[step - 1], -(step - 1));
+            for (int auxstep = step - 1; auxstep > 0; auxstep--) {
+                cons.add_variable(arm[auxstep - 1], 1);
             }
+            cons.commit(0, step-1);
+            step--;
         }
-
-        cons.commit(groupValue[a], groupValue[a]);
     }
 
-    // Restrictions for rows and columns not in a "cross" for each group
-    for (int k = 0; k < g; k++) {
-        auto cons = mip.constraint();
-        int ii = groupi[k];
-        int jj = groupj[k];
-
-        // first for rows
-        for (int j = 0; j < h; j++) {
-            for (int i = 0; i < w; i++) {
-                if (i != ii && j != jj) {
-                    cons.add_variable(branches[j][i][k], 1);
-                }
+    // Solve and print.
+    auto sol = solveMIP(mip, options);
+    auto values = sol.values();
+
+    // each arm ends at its farthest branch
+    vector<int> arms(4 * g, 0);
+    for (int a = 0; a < 4 * g; a++) {
+        for (int v = armStart[a]; v < armStart[a + 1]; v++) {
+            if (values[branches[v]] > 0.5) {
+                arms[a] = v - armStart[a] + 1;
             }
         }
-        cons.commit(0, 0);
     }
+    return arms;
+}
 
-    // For each group we iterate line and column (until wall or another group)
-    // and each step makes a new constraint
+// Arm formulation: an integer length per arm (bounded by its reach) adds up to the group value, and
+// covers[armStart[a] + step - 1] = if arm a covers its step-th cell is derived from it: the covers add up
+// to the length and each one needs the one before, with two nonzeros per row instead of a growing chain
+vector<int> solveArmModel(MIPSolver& mip, const Board& b, const Groups& groups, const Part& part, const Options& options) {
+    int w = b.w, h = b.h, g = part.members.size();
+
+    vector<int> armStart(4 * g + 1, 0);
+    for (int a = 0; a < 4 * g; a++) {
+        armStart[a + 1] = armStart[a] + part.limit[a];
+    }
+    vector<Variable> length, covers;
+    length.reserve(4 * g);
+    covers.reserve(armStart[4 * g]);
+    for (int a = 0; a < 4 * g; a++) {
+        length.push_back(mip.integer_variable(0, part.limit[a], 0));
+    }
+    for (int v = 0; v < armStart[4 * g]; v++) {
+        covers.push_back(mip.binary_variable(0));
+    }
 
-    // iterate through groups
+    // the lengths of a group add up to its value
     for (int a = 0; a < g; a++) {
-        int i = groupi[a];
-        int j = groupj[a];
+        int value = groups.value[part.members[a]];
+        mip.add_row(&length[4 * a], 4, 1, value, value);
+    }
+
+    // an arm covers as many cells as its length, from the group on
+    for (int a = 0; a < 4 * g; a++) {
+        auto& cons = mip.row();
+        cons.add_variable(length[a], 1);
+        cons.add_variables(&covers[armStart[a]], part.limit[a], -1);
+        cons.commit(0, 0);
+        for (int v = armStart[a] + 1; v < armStart[a + 1]; v++) {
+            Variable step[] = {covers[v - 1], covers[v]};
+            double coefs[] = {-1, 1};
+            mip.add_row(step, coefs, 2, -1, 0);
+        }
+    }
 
+    // every cell is covered once, by one of the arms that reach it
+    vector<Variable> candidates(4 * w * h, NullVariable());
+    for (int a = 0; a < 4 * g; a++) {
+        int group = part.members[a / 4], k = a % 4;
+        for (int step = 1; step <= part.limit[a]; step++) {
+            int c = (groups.j[group] + dy[k] * step) * w + groups.i[group] + dx[k] * step;
+            candidates[4 * c + k] = covers[armStart[a] + step - 1];
+        }
+    }
+    for (int c : part.cells) {
+        auto& cons = mip.row();
         for (int k = 0; k < 4; k++) {
-            int jj = j + dy[k], ii = i + dx[k];
-
-            // each step is a constraint
-            // go to the last possible path!
-            int step = 1; // we already walked
-            while (step < groupValue[a]) {
-                jj += dy[k];
-                ii += dx[k];
-                step++;
-                if (!valid(ii, jj, w, h) || board[jj][ii] != '.') {
-                    jj -= dy[k];
-                    ii -= dx[k];
-                    step--;
-                    break;
-                }
+            cons.add_variable(candidates[4 * c + k], 1);
+        }
+        cons.commit(1, 1);
+    }
+
+    auto sol = solveMIP(mip, options);
+    auto values = sol.values();
+    vector<int> arms(4 * g, 0);
+    for (int a = 0; a < 4 * g; a++) {
+        arms[a] = (int) (values[length[a]] + 0.5);
+    }
+    return arms;
+}
+
+vector<int> buildAndSolve(MIPSolver& mip, const Board& b, const Groups& groups, const Part& part, const Options& options) {
+    if (options.formulation == ARM_FORMULATION) {
+        return solveArmModel(mip, b, groups, part, options);
+    }
+    return solveCellModel(mip, b, groups, part, options);
+}
+
+// Solves the part, and when comparing solves it serially first on a solver of its own (so the concurrent
+// solve does not start from its solutions) and reports both times on stderr
+vector<int> solvePart(MIPSolver& mip, const Board& b, const Groups& groups, const Part& part, const Options& options) {
+    if (!options.concurrent || !options.compareSerial) {
+        vector<int> arms = buildAndSolve(mip, b, groups, part, options);
+        if (options.stats != NULL) {
+            string json = mip.stats().json();
+            lock_guard<mutex> guard(options.stats->lock);
+            options.stats->mips.push_back(json);
+        }
+        return arms;
+    }
+    Options serial = options;
+    serial.concurrent = false;
+    MIPSolver serialMIP(NULL);
+    auto start = chrono::steady_clock::now();
+    buildAndSolve(serialMIP, b, groups, part, serial);
+    auto middle = chrono::steady_clock::now();
+    vector<int> arms = buildAndSolve(mip, b, groups, part, options);
+    auto end = chrono::steady_clock::now();
+    double serialSeconds = chrono::duration<double>(middle - start).count();
+    double concurrentSeconds = chrono::duration<double>(end - middle).count();
+    cerr << "part of " << part.members.size() << " groups: serial " << serialSeconds << " s, concurrent "
+         << concurrentSeconds << " s, speedup " << serialSeconds / max(concurrentSeconds, 1e-9) << endl;
+    return arms;
+}
+
+int findRoot(vector<int>& parent, int x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+enum Propagation {SOLVED, NO_SOLUTION, GAVE_UP};
+
+// Exact engine: bit l of length[4 * k + d] is set while the arm of group k in direction d can still
+// have length l, and bit d of owners[c] while cell c can still be covered by the arm going in direction d
+// that reaches it (at most one per direction, the nearest number). Arms are checked against each group sum
+// and against the cells they cover to a fixpoint. Before searching, owners that fail right away are removed
+// (probing), then the search backtracks on the cell with the fewest owners left. Every change goes to a trail to be undone.
+struct Propagator {
+    const Board& b;
+    Groups groups;
+    vector<int> reach;  // 4 per group
+    vector<int> owner;  // 4 per cell, group whose arm in direction d reaches the cell, or -1
+    vector<unsigned short> length;
+    vector<unsigned char> owners;
+    vector<pair<int, int>> trail; // (index, old domain), lengths first and then owners
+    vector<int> queue;
+    vector<char> queued;
+    long nodes, nodeLimit;
+
+    Propagator(const Board& board, long limit);
+    bool start();
+    void setLength(int i, unsigned short domain);
+    void setOwners(int c, unsigned char domain);
+    void undo(int mark);
+    void touch(int c, int except);
+    bool revise(int k);
+    bool propagate();
+    bool probe();
+    vector<vector<int>> components();
+    Propagation search(const vector<int>& cells);
+};
+
+Propagator::Propagator(const Board& board, long limit) : b(board), nodes(0), nodeLimit(limit) {
+    groups = findGroups(b);
+    int g = groups.value.size();
+    reach.resize(4 * g);
+    owner.assign(4 * b.w * b.h, -1);
+    queued.assign(g, 0);
+    for (int k = 0; k < g; k++) {
+        for (int d = 0; d < 4; d++) {
+            reach[4 * k + d] = ::reach(b, groups, k, d);
+            for (int t = 1; t <= reach[4 * k + d]; t++) {
+                int c = (groups.j[k] + dy[d] * t) * b.w + groups.i[k] + dx[d] * t;
+                owner[4 * c + d] = k;
             }
+        }
+    }
+}
 
-            // lets walk back
-            while (step > 1) {
-                auto cons = mip.constraint();
+// Initial domains, false if some cell can not be covered at all
+bool Propagator::start() {
+    int g = groups.value.size();
+    length.resize(4 * g);
+    for (int k = 0; k < 4 * g; k++) {
+        length[k] = (1 << (reach[k] + 1)) - 1;
+    }
+    owners.assign(b.w * b.h, 0);
+    for (int c = 0; c < b.w * b.h; c++) {
+        for (int d = 0; d < 4; d++) {
+            if (owner[4 * c + d] >= 0) {
+                owners[c] |= 1 << d;
+            }
+        }
+        if (b.cells[c] == '.' && owners[c] == 0) {
+            return false;
+        }
+    }
+    for (int k = 0; k < g; k++) {
+        queue.push_back(k);
+        queued[k] = 1;
+    }
+    return true;
+}
 
-                int auxi = ii;
-                int auxj = jj;
-                int auxstep = step-1;
+void Propagator::setLength(int i, unsigned short domain) {
+    trail.push_back(make_pair(i, (int) length[i]));
+    length[i] = domain;
+}
 
-                cons.add_variable(branches[auxj][auxi][a], -auxstep);
-                while (auxstep > 0) {
-                    auxstep--;
-                    auxi -= dx[k];
-                    auxj -= dy[k];
-                    cons.add_variable(branches[auxj][auxi][a], 1);
+void Propagator::setOwners(int c, unsigned char domain) {
+    trail.push_back(make_pair((int) length.size() + c, (int) owners[c]));
+    owners[c] = domain;
+}
+
+void Propagator::undo(int mark) {
+    while ((int) trail.size() > mark) {
+        int i = trail.back().first;
+        if (i < (int) length.size()) {
+            length[i] = trail.back().second;
+        } else {
+            owners[i - length.size()] = trail.back().second;
+        }
+        trail.pop_back();
+    }
+}
+
+// The owners of cell c changed, its groups must be revised again
+void Propagator::touch(int c, int except) {
+    for (int d = 0; d < 4; d++) {
+        int k = owner[4 * c + d];
+        if (k >= 0 && k != except && !queued[k]) {
+            queue.push_back(k);
+            queued[k] = 1;
+        }
+    }
+}
+
+// Narrows the arms of group k and the cells they reach, false on a wipe out
+bool Propagator::revise(int k) {
+    int value = groups.value[k];
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        // the four lengths must add up to the value (domains are intervals, so bounds are enough)
+        int low[4], high[4], sumLow = 0, sumHigh = 0;
+        for (int d = 0; d < 4; d++) {
+            unsigned short domain = length[4 * k + d];
+            if (domain == 0) {
+                return false;
+            }
+            low[d] = __builtin_ctz(domain);
+            high[d] = 31 - __builtin_clz(domain);
+            sumLow += low[d];
+            sumHigh += high[d];
+        }
+        for (int d = 0; d < 4; d++) {
+            int from = max(0, value - (sumHigh - high[d]));
+            int to = value - (sumLow - low[d]);
+            unsigned short range = to < from ? 0 : ((1 << (to + 1)) - 1) & ~((1 << from) - 1);
+            unsigned short domain = length[4 * k + d];
+            if ((domain & range) != domain) {
+                setLength(4 * k + d, domain & range);
+                if ((domain & range) == 0) {
+                    return false;
                 }
-                cons.commit(0, step-1);
+                changed = true;
+            }
+        }
 
-                jj -= dy[k];
-                ii -= dx[k];
-                step--;
+        // the arm covers its t-th cell iff its length is at least t
+        for (int d = 0; d < 4; d++) {
+            unsigned char bit = 1 << d;
+            for (int t = 1; t <= reach[4 * k + d]; t++) {
+                int c = (groups.j[k] + dy[d] * t) * b.w + groups.i[k] + dx[d] * t;
+                unsigned short atLeast = ~((1 << t) - 1);
+                unsigned short domain = length[4 * k + d], narrowed = domain;
+                if (!(owners[c] & bit)) {
+                    narrowed &= ~atLeast;
+                } else if (!(domain & atLeast)) {
+                    if (owners[c] == bit) {
+                        return false;
+                    }
+                    setOwners(c, owners[c] & ~bit);
+                    touch(c, k);
+                } else if (owners[c] == bit) {
+                    narrowed &= atLeast;
+                } else if (!(domain & ~atLeast)) {
+                    setOwners(c, bit);
+                    touch(c, k);
+                }
+                if (narrowed != domain) {
+                    if (narrowed == 0) {
+                        return false;
+                    }
+                    setLength(4 * k + d, narrowed);
+                    changed = true;
+                }
             }
         }
     }
+    return true;
+}
 
-    // Solve and print.
-    auto sol = mip.solve();
+bool Propagator::propagate() {
+    bool consistent = true;
+    while (!queue.empty()) {
+        int k = queue.back();
+        queue.pop_back();
+        queued[k] = 0;
+        if (consistent && !revise(k)) {
+            consistent = false;
+        }
+    }
+    return consistent;
+}
 
-    vector<vector<char>> out(h, vector<char>(w, '.'));
-    for (int j = 0; j < h; j++) {
-        for (int i = 0; i < w; i++) {
-            for (int k = 0; k < g; k++) {
-                if (sol.value(branches[j][i][k]) < 0.5) {
+// Removes every owner whose assignment fails at once, until none does, false if the board fails
+bool Propagator::probe() {
+    bool probed = true;
+    while (probed) {
+        probed = false;
+        for (int c = 0; c < b.w * b.h; c++) {
+            for (int d = 0; d < 4 && __builtin_popcount(owners[c]) > 1; d++) {
+                if (!(owners[c] & (1 << d))) {
                     continue;
                 }
-                int ii = groupi[k];
-                int jj = groupj[k];
-                for (int xi = min(i, ii); xi <= max(i, ii); xi++) {
-                    for (int xj = min(j, jj); xj <= max(j, jj); xj++) {
-                        out[xj][xi] = xi == ii ? '|' : '-';
+                int mark = trail.size();
+                setOwners(c, 1 << d);
+                touch(c, -1);
+                bool consistent = propagate();
+                undo(mark);
+                if (!consistent) {
+                    setOwners(c, owners[c] & ~(1 << d));
+                    touch(c, -1);
+                    if (!propagate()) {
+                        return false;
                     }
+                    probed = true;
                 }
-                out[j][i] = i < ii ? '<' : (
-                            i > ii ? '>' : (
-                            j < jj ? '^' : 'v'));
             }
         }
     }
-    for (int k = 0; k < g; k++) {
-        out[groupj[k]][groupi[k]] = '0' + groupValue[k];
+    return true;
+}
+
+// Cells that still have several owners, split in independent sets (no group can cover cells of two sets)
+vector<vector<int>> Propagator::components() {
+    vector<int> parent(groups.value.size());
+    for (int k = 0; k < (int) parent.size(); k++) {
+        parent[k] = k;
+    }
+    vector<int> open;
+    for (int c = 0; c < b.w * b.h; c++) {
+        if (__builtin_popcount(owners[c]) < 2) {
+            continue;
+        }
+        open.push_back(c);
+        int first = -1;
+        for (int d = 0; d < 4; d++) {
+            if (owners[c] & (1 << d)) {
+                int k = findRoot(parent, owner[4 * c + d]);
+                if (first < 0) {
+                    first = k;
+                } else {
+                    parent[k] = findRoot(parent, first);
+                }
+            }
+        }
+    }
+    vector<int> index(parent.size(), -1);
+    vector<vector<int>> sets;
+    for (int c : open) {
+        int root = findRoot(parent, owner[4 * c + __builtin_ctz(owners[c])]);
+        if (index[root] < 0) {
+            index[root] = sets.size();
+            sets.push_back(vector<int>());
+        }
+        sets[index[root]].push_back(c);
     }
-    for (int j = 0; j < h; j++) {
-        for (int i = 0; i < w; i++) {
-            cout << out[j][i];
+    return sets;
+}
+
+// Searches for an assignment of the given cells, which must not share groups with cells outside of them
+Propagation Propagator::search(const vector<int>& cells) {
+    if (!propagate()) {
+        return NO_SOLUTION;
+    }
+    int branch = -1, fewest = 5;
+    for (int c : cells) {
+        int count = __builtin_popcount(owners[c]);
+        if (count > 1 && count < fewest) {
+            branch = c;
+            fewest = count;
+        }
+    }
+    if (branch < 0) {
+        return SOLVED; // every cell has one owner, so every arm has one length
+    }
+    unsigned char candidates = owners[branch];
+    for (int d = 0; d < 4; d++) {
+        if (!(candidates & (1 << d))) {
+            continue;
+        }
+        if (++nodes > nodeLimit) {
+            return GAVE_UP;
+        }
+        int mark = trail.size();
+        setOwners(branch, 1 << d);
+        touch(branch, -1);
+        Propagation result = search(cells);
+        if (result != NO_SOLUTION) {
+            return result;
+        }
+        undo(mark);
+    }
+    return NO_SOLUTION;
+}
+
+// Solves the board with the exact engine, the drawing is only set when it is SOLVED
+Propagation propagateBoard(const Board& b, string& drawing, long nodeLimit) {
+    Propagator propagator(b, nodeLimit);
+    if (!propagator.start() || !propagator.propagate() || !propagator.probe()) {
+        return NO_SOLUTION;
+    }
+    // independent parts of the board are searched one after the other, so a failure in one
+    // does not undo the others
+    Propagation result = SOLVED;
+    for (const vector<int>& cells : propagator.components()) {
+        result = propagator.search(cells);
+        if (result != SOLVED) {
+            break;
+        }
+    }
+    if (result == SOLVED) {
+        vector<int> arms(propagator.length.size());
+        for (int k = 0; k < (int) arms.size(); k++) {
+            arms[k] = __builtin_ctz(propagator.length[k]);
+        }
+        drawing = drawArms(b, propagator.groups, arms);
+    }
+    return result;
+}
+
+// Solves the board as a MIP. With decompose, the arms forced by propagation are fixed first, and the groups
+// left are split in independent parts (two groups are in the same part when a cell can still be covered by both),
+// each part being a small MIP of its own, solved concurrently on solvers from the pool
+string solveBoardMIP(SolverPool& pool, const Board& b, const Options& options) {
+    if (!options.decompose) {
+        Groups groups = findGroups(b);
+        auto mip = pool.acquire();
+        return drawArms(b, groups, solvePart(*mip, b, groups, wholeBoard(b, groups), options));
+    }
+
+    Propagator propagator(b, 0);
+    if (!propagator.start() || !propagator.propagate()) {
+        cerr << "The board has no solution" << endl;
+        return "";
+    }
+    const Groups& groups = propagator.groups;
+    int g = groups.value.size();
+    vector<int> arms(4 * g), parent(g);
+    for (int a = 0; a < g; a++) {
+        parent[a] = a;
+    }
+    for (int c = 0; c < b.w * b.h; c++) {
+        int first = -1;
+        for (int d = 0; d < 4; d++) {
+            if (propagator.owners[c] & (1 << d)) {
+                int k = propagator.owner[4 * c + d];
+                if (first < 0) {
+                    first = k;
+                } else {
+                    parent[findRoot(parent, k)] = findRoot(parent, first);
+                }
+            }
+        }
+    }
+
+    // groups whose arms are all fixed are done, the others go to the part of their root
+    vector<int> partOf(g, -1);
+    vector<Part> parts;
+    for (int a = 0; a < g; a++) {
+        bool fixed = true;
+        for (int d = 0; d < 4; d++) {
+            unsigned short domain = propagator.length[4 * a + d];
+            fixed = fixed && (domain & (domain - 1)) == 0;
+            arms[4 * a + d] = __builtin_ctz(domain);
+        }
+        if (fixed) {
+            continue;
         }
-        cout << endl;
+        int root = findRoot(parent, a);
+        if (partOf[root] < 0) {
+            partOf[root] = parts.size();
+            parts.push_back(Part());
+        }
+        Part& part = parts[partOf[root]];
+        part.members.push_back(a);
+        for (int d = 0; d < 4; d++) {
+            part.limit.push_back(31 - __builtin_clz(propagator.length[4 * a + d]));
+        }
+    }
+    // a cell goes to the part of the groups that can still cover it (they all share one), cells that
+    // can be covered by a fixed group have no other owner left
+    for (int c = 0; c < b.w * b.h; c++) {
+        for (int d = 0; d < 4; d++) {
+            if (propagator.owners[c] & (1 << d)) {
+                int root = findRoot(parent, propagator.owner[4 * c + d]);
+                if (partOf[root] >= 0) {
+                    parts[partOf[root]].cells.push_back(c);
+                }
+                break;
+            }
+        }
+    }
+
+    parallel_for(parts.size(), options.threads, [&](int worker, int p) {
+        auto mip = pool.acquire();
+        vector<int> partArms = solvePart(*mip, b, groups, parts[p], options);
+        for (int a = 0; a < (int) parts[p].members.size(); a++) {
+            for (int d = 0; d < 4; d++) {
+                arms[4 * parts[p].members[a] + d] = partArms[4 * a + d];
+            }
+        }
+    });
+    return drawArms(b, groups, arms);
+}
+
+// Solves the board with the chosen engine, taking a solver from the pool only if the MIP is needed
+string solveBoardEngines(const Board& b, const Options& options, SolverPool& pool) {
+    string drawing;
+    if (options.engine != MIP_ENGINE) {
+        auto start = chrono::steady_clock::now();
+        Propagation result = propagateBoard(b, drawing, options.nodeLimit);
+        if (options.stats != NULL) {
+            options.stats->addPhase("propagation", chrono::duration<double>(chrono::steady_clock::now() - start).count());
+        }
+        if (result == SOLVED) {
+            return drawing;
+        }
+        if (result == NO_SOLUTION) {
+            cerr << "The board has no solution" << endl;
+            return drawing;
+        }
+        if (options.engine == PROPAGATION_ENGINE) {
+            cerr << "Propagation gave up after " << options.nodeLimit << " nodes" << endl;
+            return drawing;
+        }
+    }
+    auto start = chrono::steady_clock::now();
+    drawing = solveBoardMIP(pool, b, options);
+    if (options.stats != NULL) {
+        options.stats->addPhase("mip", chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    return drawing;
+}
+
+// Same, looking in the cache first (under a hash of the board) and keeping valid drawings there
+string solveBoard(const Board& b, const Options& options, SolverPool& pool) {
+    string drawing;
+    string key;
+    if (options.cache != NULL) {
+        Hasher hasher;
+        hasher.add(string("branches drawing 1"));
+        hasher.add(b.w);
+        hasher.add(b.h);
+        hasher.add(b.cells);
+        key = "branches-" + hasher.hex();
+        Record record;
+        if (options.cache->load(key, &record) && record.get(&drawing) && validDrawing(b, drawing)) {
+            return drawing;
+        }
+        drawing.clear();
+    }
+    drawing = solveBoardEngines(b, options, pool);
+    if (options.cache != NULL && validDrawing(b, drawing)) {
+        Record record;
+        record.put(drawing);
+        options.cache->store(key, record);
+    }
+    return drawing;
+}
+
+// Every board of a stream, one after the other, until a malformed one
+void readBoards(Reader& in, const string& source, vector<Board>& boards) {
+    Board b;
+    while (readBoard(in, b)) {
+        boards.push_back(b);
+    }
+    if (!in.ok()) {
+        cerr << "Bad input in " << source << ", " << in.error() << endl;
+    }
+}
+
+// Boards of a batch, either every file of a directory (in name order, skipping the ones
+// that are not boards) or every board of a stream
+vector<Board> readBatch(const string& source) {
+    vector<Board> boards;
+    Board b;
+    if (source == "-") {
+        Reader in;
+        readBoards(in, source, boards);
+        return boards;
+    }
+
+    DIR *dir = opendir(source.c_str());
+    if (dir == NULL) {
+        Reader in(source);
+        readBoards(in, source, boards);
+        return boards;
+    }
+
+    vector<string> files;
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            files.push_back(source + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+    sort(files.begin(), files.end());
+    for (const string& file : files) {
+        Reader in(file);
+        if (readBoard(in, b)) {
+            boards.push_back(b);
+        } else {
+            cerr << "Skipping " << file << ", not a board (" << (in.ok() ? "empty" : in.error()) << ")" << endl;
+        }
+    }
+    return boards;
+}
+
+// Batch mode: boards are solved concurrently, the MIP on solvers taken from a pool (already set up, one per thread),
+// and results are printed in input order with per-board and total times on stderr
+int solveBatch(const string& source, int threads, const Options& options, const char *logFile) {
+    auto start = chrono::steady_clock::now();
+    vector<Board> boards = readBatch(source);
+    vector<string> drawings(boards.size());
+    vector<double> seconds(boards.size());
+
+    threads = max(1, min(threads, (int) boards.size()));
+    SolverPool pool(logFile);
+    if (options.engine == MIP_ENGINE) {
+        pool.prewarm(threads);
+    }
+    Options boardOptions = options;
+    boardOptions.threads = 1; // boards already keep every thread busy
+    parallel_for(boards.size(), threads, [&](int worker, int i) {
+        auto boardStart = chrono::steady_clock::now();
+        drawings[i] = solveBoard(boards[i], boardOptions, pool);
+        seconds[i] = chrono::duration<double>(chrono::steady_clock::now() - boardStart).count();
+    });
+
+    double total = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    for (int i = 0; i < (int) boards.size(); i++) {
+        cout << drawings[i] << endl;
+        cerr << "board " << i << ": " << boards[i].w << "x" << boards[i].h << ", " << boards[i].g << " groups, "
+             << seconds[i] * 1000 << " ms" << endl;
+    }
+    cerr << boards.size() << " boards in " << total << " s on " << threads << " threads, "
+         << boards.size() / max(total, 1e-9) << " boards/s" << endl;
+    return 0;
+}
+
+// Solves every board of the source with propagation and both MIP formulations, one after the other,
+// and compares their times
+int benchmark(const string& source, const Options& options, const char *logFile) {
+    vector<Board> boards = readBatch(source);
+    SolverPool pool(logFile);
+    Options run = options;
+    double total[3] = {0, 0, 0};
+    for (int i = 0; i < (int) boards.size(); i++) {
+        string drawings[3];
+        double seconds[3];
+        auto start = chrono::steady_clock::now();
+        Propagation result = propagateBoard(boards[i], drawings[0], options.nodeLimit);
+        auto end = chrono::steady_clock::now();
+        seconds[0] = chrono::duration<double>(end - start).count();
+        for (int f = 0; f < 2; f++) {
+            start = chrono::steady_clock::now();
+            run.formulation = f == 0 ? CELL_FORMULATION : ARM_FORMULATION;
+            drawings[f + 1] = solveBoardMIP(pool, boards[i], run);
+            end = chrono::steady_clock::now();
+            seconds[f + 1] = chrono::duration<double>(end - start).count();
+        }
+        for (int e = 0; e < 3; e++) {
+            total[e] += seconds[e];
+        }
+        cout << "board " << i << ": " << boards[i].w << "x" << boards[i].h << ", " << boards[i].g << " groups, "
+             << "propagation " << seconds[0] * 1e6 << " us ("
+             << (result == SOLVED ? "solved" : result == NO_SOLUTION ? "no solution" : "gave up") << "), "
+             << "cell MIP " << seconds[1] * 1e6 << " us, arm MIP " << seconds[2] * 1e6 << " us, "
+             << (drawings[0] == drawings[1] && drawings[1] == drawings[2] ? "same drawing" : "different drawing") << endl;
+    }
+    cout << boards.size() << " boards, propagation " << total[0] * 1e3 << " ms, cell MIP " << total[1] * 1e3
+         << " ms, arm MIP " << total[2] * 1e3 << " ms, propagation speedup " << total[1] / max(total[0], 1e-9)
+         << ", arm MIP speedup " << total[1] / max(total[2], 1e-9) << endl;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *batch = NULL;
+    const char *bench = NULL;
+    int threads = default_threads();
+    Options options;
+    const char *logFile = "log.txt";
+    const char *statsFile = NULL;
+    const char *cacheDir = NULL;
+    bool logSet = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--batch") && i + 1 < argc) {
+            batch = argv[++i];
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--engine") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "auto")) {
+                options.engine = AUTO_ENGINE;
+            } else if (!strcmp(argv[i], "propagation")) {
+                options.engine = PROPAGATION_ENGINE;
+            } else if (!strcmp(argv[i], "mip")) {
+                options.engine = MIP_ENGINE;
+            } else {
+                cerr << "Unknown engine " << argv[i] << endl;
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--model") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "cells")) {
+                options.formulation = CELL_FORMULATION;
+            } else if (!strcmp(argv[i], "arms")) {
+                options.formulation = ARM_FORMULATION;
+            } else {
+                cerr << "Unknown model " << argv[i] << endl;
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--concurrent")) {
+            options.concurrent = true;
+        } else if (!strcmp(argv[i], "--solver-threads") && i + 1 < argc) {
+            options.parallel.threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            options.parallel.seed = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--emphasis") && i + 1 < argc) {
+            istringstream list(argv[++i]);
+            string emphasis;
+            while (getline(list, emphasis, ',')) {
+                options.parallel.emphasis.push_back(emphasis);
+            }
+        } else if (!strcmp(argv[i], "--deterministic")) {
+            options.parallel.deterministic = true;
+        } else if (!strcmp(argv[i], "--stats") && i + 1 < argc) {
+            statsFile = argv[++i];
+        } else if (!strcmp(argv[i], "--settings") && i + 1 < argc) {
+            options.settings = argv[++i];
+        } else if (!strcmp(argv[i], "--compare-serial")) {
+            options.compareSerial = true;
+        } else if (!strcmp(argv[i], "--no-decompose")) {
+            options.decompose = false;
+        } else if (!strcmp(argv[i], "--node-limit") && i + 1 < argc) {
+            options.nodeLimit = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--cache") && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (!strcmp(argv[i], "--benchmark") && i + 1 < argc) {
+            bench = argv[++i];
+        } else if (!strcmp(argv[i], "--log") && i + 1 < argc) {
+            logFile = argv[++i];
+            logSet = true;
+        } else if (!strcmp(argv[i], "--quiet")) {
+            logFile = NULL;
+            logSet = true;
+        } else {
+            cerr << "usage: " << argv[0] << " [--log file | --quiet] [--engine auto|propagation|mip] [--model cells|arms] [--no-decompose] [--node-limit n] [--threads n] [--settings file.set] [--stats file.json] [--cache dir]"
+                 << " [--concurrent [--solver-threads n] [--seed n] [--emphasis e1,e2,...] [--deterministic] [--compare-serial]]"
+                 << " [--batch <directory, file or - for stdin> | --benchmark <directory or file>] < board" << endl;
+            return 1;
+        }
+    }
+
+    options.threads = threads; // in batch mode for boards, otherwise for the parts of the board
+    unique_ptr<ResultCache> cache;
+    if (cacheDir != NULL) {
+        cache.reset(new ResultCache(cacheDir));
+        options.cache = cache.get();
+    }
+    if (batch != NULL) {
+        // many solvers at once would mix their messages, so batches are quiet unless asked otherwise
+        return solveBatch(batch, threads, options, logSet ? logFile : NULL);
+    }
+    if (bench != NULL) {
+        return benchmark(bench, options, logSet ? logFile : NULL);
+    }
+
+    StatsLog stats;
+    if (statsFile != NULL) {
+        options.stats = &stats;
+    }
+    auto start = chrono::steady_clock::now();
+    Board b;
+    Reader input;
+    if (!readBoard(input, b)) {
+        cerr << "Bad input, " << (input.ok() ? "no board" : input.error()) << endl;
+        return 1;
+    }
+    stats.addPhase("parsing", chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    SolverPool pool(logFile);
+    cout << solveBoard(b, options, pool);
+    if (statsFile != NULL) {
+        ofstream out(statsFile);
+        out << stats.json() << endl;
     }
 }
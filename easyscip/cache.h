@@ -0,0 +1,157 @@
+// Keeps results on disk, named by a hash of the input they came from.
+// Part of EasySCIP, see easyscip.h.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace easyscip {
+
+// 64-bit FNV-1a over everything added, enough to tell inputs apart.
+class Hasher {
+ public:
+  Hasher() : hash_(14695981039346656037ULL) {
+  }
+  void add(const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash_ = (hash_ ^ bytes[i]) * 1099511628211ULL;
+    }
+  }
+  // Plain values (ints, doubles) are hashed by their bytes, containers by
+  // their size and then their contents.
+  template <typename T>
+  void add(const T& value) {
+    add(&value, sizeof(value));
+  }
+  template <typename T>
+  void add(const std::vector<T>& values) {
+    add(values.size());
+    add(values.data(), values.size() * sizeof(T));
+  }
+  void add(const std::string& text) {
+    add(text.size());
+    add(text.data(), text.size());
+  }
+  std::string hex() const {
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx",
+             static_cast<unsigned long long>(hash_));
+    return text;
+  }
+ private:
+  uint64_t hash_;
+};
+
+// Compact binary form of a cache entry: values are appended as raw bytes and
+// read back in the same order, get() is false once the data runs out.
+class Record {
+ public:
+  Record() : pos_(0) {
+  }
+  explicit Record(const std::string& data) : data_(data), pos_(0) {
+  }
+  template <typename T>
+  void put(const T& value) {
+    data_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+  template <typename T>
+  void put(const std::vector<T>& values) {
+    put(values.size());
+    data_.append(reinterpret_cast<const char*>(values.data()),
+                 values.size() * sizeof(T));
+  }
+  void put(const std::string& text) {
+    put(text.size());
+    data_.append(text);
+  }
+  template <typename T>
+  bool get(T *value) {
+    return take(value, sizeof(*value));
+  }
+  template <typename T>
+  bool get(std::vector<T> *values) {
+    size_t size;
+    if (!get(&size) || size > (data_.size() - pos_) / sizeof(T)) {
+      return false;
+    }
+    values->resize(size);
+    return take(values->data(), size * sizeof(T));
+  }
+  bool get(std::string *text) {
+    size_t size;
+    if (!get(&size) || size > data_.size() - pos_) {
+      return false;
+    }
+    text->assign(data_, pos_, size);
+    pos_ += size;
+    return true;
+  }
+  const std::string& data() const {
+    return data_;
+  }
+ private:
+  bool take(void *out, size_t size) {
+    if (size > data_.size() - pos_) {
+      return false;
+    }
+    memcpy(out, data_.data() + pos_, size);
+    pos_ += size;
+    return true;
+  }
+  std::string data_;
+  size_t pos_;
+};
+
+// A directory with one file per key. Entries are written to a temporary
+// file and renamed into place, so runs sharing the directory (or threads
+// of one run) never read half an entry.
+class ResultCache {
+ public:
+  // The directory is created if needed.
+  explicit ResultCache(const std::string& dir) : dir_(dir) {
+    mkdir(dir_.c_str(), 0777);
+  }
+  bool load(const std::string& key, Record *record) const {
+    std::ifstream in(path(key), std::ios::binary);
+    if (!in) {
+      return false;
+    }
+    std::ostringstream data;
+    data << in.rdbuf();
+    *record = Record(data.str());
+    return true;
+  }
+  bool store(const std::string& key, const Record& record) const {
+    std::ostringstream temporary;
+    temporary << path(key) << ".tmp" << getpid() << "-"
+              << std::hash<std::thread::id>()(std::this_thread::get_id());
+    {
+      std::ofstream out(temporary.str(), std::ios::binary);
+      out.write(record.data().data(), record.data().size());
+      if (!out) {
+        return false;
+      }
+    }
+    if (rename(temporary.str().c_str(), path(key).c_str()) != 0) {
+      remove(temporary.str().c_str());
+      return false;
+    }
+    return true;
+  }
+ private:
+  std::string path(const std::string& key) const {
+    return dir_ + "/" + key;
+  }
+  std::string dir_;
+};
+
+}  // namespace easyscip
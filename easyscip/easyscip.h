@@ -4,6 +4,16 @@
 
 // Please check the examples for a sample usage.
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include "objscip/objscip.h"
@@ -12,25 +22,38 @@
 namespace easyscip {
 
 class Constraint;
-class MIPConstraint;
+class Row;
+class RowBuilder;
 class Solution;
-class MIPSolution;
-class LPSolution;
+class SolutionValues;
 class MIPSolver;
 class Handler;
-class DynamicConstraint;
+class Pricing;
+class Pricer;
+class Brancher;
+class Decisions;
 
+// Variables are plain indexes into the solver's variable table,
+// so they are cheap to copy and store in big containers.
 class Variable {
+ public:
+  // Variables are numbered in creation order, null variables are -1.
+  int index() const {
+    return index_;
+  }
  protected:
-  Variable() : var_(NULL) {
+  Variable() : index_(-1) {
   }
-  SCIP_VAR *var_;
+  explicit Variable(int index) : index_(index) {
+  }
+  int index_;
   friend Constraint;
-  friend MIPConstraint;
+  friend RowBuilder;
   friend Solution;
-  friend MIPSolution;
-  friend LPSolution;
+  friend SolutionValues;
   friend MIPSolver;
+  friend Brancher;
+  friend Decisions;
 };
 
 class NullVariable : public Variable {
@@ -39,236 +62,670 @@ class NullVariable : public Variable {
   }
 };
 
-class BinaryVariable : public Variable {
- protected:
-  BinaryVariable(SCIP *scip, double objective, std::string name) {
-    SCIPcreateVarBasic(
-        scip, &var_, name.c_str(), 0, 1, objective, SCIP_VARTYPE_BINARY);
-    SCIPaddVar(scip, var_);
+// A committed constraint, only valid when the solver keeps its rows
+// (see MIPSolver::keep_rows), so it can be changed between solves.
+class Row {
+ public:
+  Row() : index_(-1) {
   }
-  friend MIPSolver;
-};
-
-class IntegerVariable : public Variable {
- protected:
-  IntegerVariable(SCIP *scip, double lower_bound, double upper_bound,
-                  double objective, std::string name) {
-    SCIPcreateVarBasic(
-        scip, &var_, name.c_str(), lower_bound, upper_bound, objective,
-        SCIP_VARTYPE_INTEGER);
-    SCIPaddVar(scip, var_);
+  bool valid() const {
+    return index_ >= 0;
   }
+ private:
+  explicit Row(int index) : index_(index) {
+  }
+  int index_;
+  friend RowBuilder;
   friend MIPSolver;
+  friend Pricing;
 };
 
-class BaseConstraint {
+// A linear constraint builder owned by the solver and reused for every row,
+// so its buffers keep their capacity and are handed to SCIP without copies.
+class RowBuilder {
  public:
-  virtual void add_variable(Variable& var, double val) = 0;
-  virtual void commit(double lower_bound, double upper_bound) = 0;
-  virtual ~BaseConstraint() {
+  void reserve(int size) {
+    vars_.reserve(size);
+    vals_.reserve(size);
   }
+  inline void add_variable(const Variable& var, double val);
+  void add_variables(const Variable *vars, int size, double val) {
+    grow(vars_.size() + size);
+    for (int i = 0; i < size; i++) {
+      add_variable(vars[i], val);
+    }
+  }
+  void add_variables(const Variable *vars, const double *vals, int size) {
+    grow(vars_.size() + size);
+    for (int i = 0; i < size; i++) {
+      add_variable(vars[i], vals[i]);
+    }
+  }
+  // Empty rows are dropped, unless the solver keeps its rows.
+  inline Row commit(double lower_bound, double upper_bound);
+ private:
+  explicit RowBuilder(MIPSolver *solver) : solver_(solver) {
+  }
+  // Room for needed terms, at least doubling, so rows built from many
+  // small batches (slot and coverage rows) don't reallocate on every batch.
+  void grow(size_t needed) {
+    if (needed > vars_.capacity()) {
+      reserve(std::max(2 * vars_.capacity(), needed));
+    }
+  }
+  void clear() {
+    vars_.clear();
+    vals_.clear();
+  }
+  MIPSolver *solver_;
+  std::vector<SCIP_VAR*> vars_;
+  std::vector<SCIP_Real> vals_;
+  friend Constraint;
+  friend MIPSolver;
 };
 
+// A handle to one of the solver's pooled builders. The builder goes back
+// to the pool, keeping its capacity, when the handle is destroyed.
 class Constraint {
  public:
-  void add_variable(Variable& var, double val) {
-    constraint_->add_variable(var, val);
+  void add_variable(const Variable& var, double val) {
+    builder_->add_variable(var, val);
+  }
+  Row commit(double lower_bound, double upper_bound) {
+    return builder_->commit(lower_bound, upper_bound);
   }
-  void commit(double lower_bound, double upper_bound) {
-    constraint_->commit(lower_bound, upper_bound);
+  Constraint(Constraint&& other)
+      : builder_(other.builder_), free_(other.free_) {
+    other.builder_ = NULL;
   }
+  Constraint(const Constraint&) = delete;
   ~Constraint() {
-    delete constraint_;
+    if (builder_ != NULL) {
+      builder_->clear();
+      free_->push_back(builder_);
+    }
   }
  private:
-  Constraint(BaseConstraint *constraint) : constraint_(constraint) {
+  Constraint(RowBuilder *builder, std::vector<RowBuilder*> *free)
+      : builder_(builder), free_(free) {
   }
-  BaseConstraint *constraint_;
+  RowBuilder *builder_;
+  std::vector<RowBuilder*> *free_;
   friend MIPSolver;
-  friend DynamicConstraint;
 };
 
-class EmptyConstraint : public BaseConstraint {
- public:
-  virtual void add_variable(Variable& var, double val) {
+// Where a solver spent its time and how its searches went, see
+// MIPSolver::stats(). Times are wall clock seconds, counts add up over
+// every solve since the solver was created or reset, bounds are those of
+// the last solve.
+struct SolveStats {
+  struct Bounds {
+    int solve;
+    double time, primal, dual;
+  };
+  // build is the time from the first change of the model to the solve (or
+  // to MIPSolver::end_build), as a whole: timing every variable and row
+  // would slow the build down.
+  double build_seconds, presolve_seconds, solve_seconds, extraction_seconds;
+  // Phases timed by the caller (input parsing for instance), in order.
+  std::vector<std::pair<std::string, double> > phases;
+  int solves;
+  long long nodes, lp_iterations;
+  double primal_bound, dual_bound, gap;
+  std::string status;
+  // Every change of the bounds, with the solving time it happened at.
+  std::vector<Bounds> history;
+  SolveStats() {
+    clear();
   }
-  virtual void commit(double lower_bound, double upper_bound) {
+  void clear() {
+    build_seconds = presolve_seconds = solve_seconds = 0;
+    extraction_seconds = 0;
+    phases.clear();
+    solves = 0;
+    nodes = lp_iterations = 0;
+    primal_bound = dual_bound = gap = 0;
+    status = "unsolved";
+    history.clear();
   }
-};
-
-class MIPConstraint : public BaseConstraint {
- public:
-  virtual void add_variable(Variable& var, double val) {
-    if (var.var_ != NULL) {
-      vars_.push_back(var.var_);
-      vals_.push_back(val);
+  void add_phase(const std::string& name, double seconds) {
+    for (auto& phase : phases) {
+      if (phase.first == name) {
+        phase.second += seconds;
+        return;
+      }
     }
+    phases.push_back(std::make_pair(name, seconds));
   }
-  virtual void commit(double lower_bound, double upper_bound) {
-    if (vars_.empty()) {
-      return;
+  std::string json() const {
+    std::string out = "{\"phases\": {";
+    for (auto& phase : phases) {
+      out += "\"" + phase.first + "\": " + number(phase.second) + ", ";
     }
-    SCIP_VAR **vars = new SCIP_VAR*[vars_.size()];
-    SCIP_Real *vals = new SCIP_Real[vals_.size()];
-    copy(vars_.begin(), vars_.end(), vars);
-    copy(vals_.begin(), vals_.end(), vals);
-    SCIP_CONS *cons;
-    SCIPcreateConsLinear(
-        scip_, &cons, name_.c_str(), vars_.size(), vars, vals,
-        lower_bound, upper_bound,
-        TRUE,   // initial
-        TRUE,   // separate
-        TRUE,   // enforce
-        TRUE,   // check
-        TRUE,   // propagate
-        FALSE,  // local
-        FALSE,  // modifiable
-        FALSE,  // dynamic
-        FALSE,  // removable
-        FALSE); // stickatnode
-    SCIPaddCons(scip_, cons);
-    SCIPreleaseCons(scip_, &cons);
-    delete[] vars;
-    delete[] vals;
+    out += "\"build\": " + number(build_seconds) +
+           ", \"presolve\": " + number(presolve_seconds) +
+           ", \"solve\": " + number(solve_seconds) +
+           ", \"extraction\": " + number(extraction_seconds) + "}";
+    out += ", \"solves\": " + number(solves) +
+           ", \"nodes\": " + number(nodes) +
+           ", \"lp_iterations\": " + number(lp_iterations) +
+           ", \"primal_bound\": " + number(primal_bound) +
+           ", \"dual_bound\": " + number(dual_bound) +
+           ", \"gap\": " + number(gap) +
+           ", \"status\": \"" + status + "\", \"history\": [";
+    for (int i = 0; i < (int) history.size(); i++) {
+      out += (i ? ", " : "") + std::string("{\"solve\": ") +
+             number(history[i].solve) +
+             ", \"time\": " + number(history[i].time) +
+             ", \"primal\": " + number(history[i].primal) +
+             ", \"dual\": " + number(history[i].dual) + "}";
+    }
+    return out + "]}";
   }
  private:
-  SCIP *scip_;
-  std::string name_;
-  std::vector<SCIP_VAR*> vars_;
-  std::vector<SCIP_Real> vals_;
-  MIPConstraint(SCIP *scip, int id)
-      : scip_(scip), name_(std::string("constraint") + std::to_string(id)) {
+  static std::string number(double value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.10g", value);
+    return text;
   }
-  friend MIPSolver;
-  friend DynamicConstraint;
 };
 
-class BaseSolution {
+// Follows every solve through SCIP events: keeps the history of the bounds
+// in the solver's stats, raises the root's bound to the caller's one, hands
+// improving solutions to the incumbent callback and stops the solve on a
+// stall or a cancel (see MIPSolver).
+class Handler : public scip::ObjEventhdlr {
  public:
-  virtual double objective() = 0;
-  virtual double value(Variable& var) = 0;
-  virtual bool is_optimal() = 0;
-  virtual ~BaseSolution() {
+  Handler(SCIP *scip, MIPSolver *solver)
+      : scip::ObjEventhdlr(scip, "easyscip", "easyscip solve progress"),
+        solver_(solver) {
+  }
+  inline virtual SCIP_DECL_EVENTINITSOL(scip_initsol);
+  virtual SCIP_DECL_EVENTEXITSOL(scip_exitsol) {
+    return SCIPdropEvent(scip, EVENTS, eventhdlr, NULL, -1);
   }
+  inline virtual SCIP_DECL_EVENTEXEC(scip_exec);
+ private:
+  // LPSOLVED too, so a cancel doesn't wait for the root node to finish.
+  static const SCIP_EVENTTYPE EVENTS = SCIP_EVENTTYPE_BESTSOLFOUND |
+      SCIP_EVENTTYPE_NODESOLVED | SCIP_EVENTTYPE_LPSOLVED;
+  MIPSolver *solver_;
 };
 
-class Solution {
+// The values of every variable of a solution, read from SCIP in one call.
+class SolutionValues {
  public:
-  double objective() const {
-    return solution_->objective();
+  double operator[](const Variable& var) const {
+    return var.index_ < 0 ? 0.0 : values_[var.index_];
   }
-  double value(Variable& var) const {
-    return solution_->value(var);
+  int size() const {
+    return values_.size();
   }
-  bool is_optimal() const {
-    return solution_->is_optimal();
-  }
-  ~Solution() {
-    delete solution_;
+  // The variables set in this solution (value above threshold, so the
+  // chosen ones for binaries), in creation order.
+  std::vector<Variable> nonzeros(double threshold = 0.5) const {
+    std::vector<Variable> chosen;
+    for (int i = 0; i < (int) values_.size(); i++) {
+      if (values_[i] > threshold) {
+        chosen.push_back(Variable(i));
+      }
+    }
+    return chosen;
   }
  private:
-  Solution(BaseSolution *solution) : solution_(solution) {
+  SolutionValues() {
   }
-  BaseSolution *solution_;
-  friend MIPSolver;
-  friend Handler;
+  std::vector<double> values_;
+  friend Solution;
 };
 
-class MIPSolution : public BaseSolution {
+// A solution is just a view over the solver, there is nothing to allocate.
+// LP solutions read the current LP values and have no objective.
+class Solution {
  public:
-  virtual double objective() {
-    return SCIPgetSolOrigObj(scip_, sol_);
+  double objective() const {
+    return lp_ ? 0 : SCIPgetSolOrigObj(scip_, sol_);
   }
-  virtual double value(Variable& var) {
-    if (var.var_ == NULL) {
+  double value(const Variable& var) const {
+    if (var.index_ < 0) {
       return 0.0;
+    } else if (lp_) {
+      return SCIPgetVarSol(scip_, (*variables_)[var.index_]);
     } else {
-      return SCIPgetSolVal(scip_, sol_, var.var_);
+      return SCIPgetSolVal(scip_, sol_, (*variables_)[var.index_]);
     }
   }
-  virtual bool is_optimal() {
+  bool is_optimal() const {
     return SCIPgetStatus(scip_) == SCIP_STATUS_OPTIMAL;
   }
- private:
-  MIPSolution(SCIP *scip, SCIP_Sol *sol) : scip_(scip), sol_(sol) {
+  SolutionValues values() const {
+    auto start = std::chrono::steady_clock::now();
+    SolutionValues values;
+    std::vector<SCIP_VAR*>& vars =
+        const_cast<std::vector<SCIP_VAR*>&>(*variables_);
+    values.values_.resize(vars.size());
+    if (vars.empty()) {
+      return values;
+    }
+    if (lp_) {
+      for (int i = 0; i < (int) vars.size(); i++) {
+        values.values_[i] = SCIPgetVarSol(scip_, vars[i]);
+      }
+    } else {
+      SCIPgetSolVals(scip_, sol_, vars.size(), vars.data(),
+                     values.values_.data());
+    }
+    if (stats_ != NULL) {
+      stats_->extraction_seconds += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+    }
+    return values;
   }
-  virtual ~MIPSolution() {
+ private:
+  Solution(SCIP *scip, SCIP_Sol *sol,
+           const std::vector<SCIP_VAR*> *variables, bool lp,
+           SolveStats *stats)
+      : scip_(scip), sol_(sol), variables_(variables), lp_(lp),
+        stats_(stats) {
   }
   SCIP *scip_;
   SCIP_Sol *sol_;
+  const std::vector<SCIP_VAR*> *variables_;
+  bool lp_;
+  // where reads are timed as extraction, NULL for the reads made while
+  // solving (incumbents, branching), which are part of the solve
+  SolveStats *stats_;
   friend MIPSolver;
   friend Handler;
+  friend Brancher;
+};
+
+// An improving solution, handed to the incumbent callback while solving
+// (see MIPSolver::on_incumbent). The solution is only valid during the call.
+struct Incumbent {
+  const Solution& solution;
+  double seconds, objective, dual_bound, gap;
 };
 
-class LPSolution : public BaseSolution {
+// The problem side of column generation (branch-and-price), see
+// MIPSolver::generate_columns. The search branches on the generator's own
+// decisions ("arc e is used" for instance), plain ints that easyscip only
+// keeps per node: branching on a column would not hold, as pricing can
+// bring the same column back.
+class ColumnGenerator {
  public:
-  virtual double objective() {
+  virtual ~ColumnGenerator() {
+  }
+  // Adds the columns of negative reduced cost at the current node, see
+  // Pricing. Adding none ends the column generation of the node.
+  virtual void price(Pricing& pricing) = 0;
+  // Splits a fractional LP solution with two decisions, one per child,
+  // given the decisions already taken on the way to the node. False when
+  // there is nothing to split, which must mean the columns are integral:
+  // a fractional column left is an error, SCIP can't branch on it.
+  virtual bool branch(const Solution& lp, const std::vector<int>& decisions,
+                      int *left, int *right) = 0;
+  // Whether a column can be nonzero under the decisions of a node, the
+  // ones that can't are fixed to 0 there.
+  virtual bool allowed(const Variable& column,
+                       const std::vector<int>& decisions) = 0;
+  // A decision can also hold with a row local to its child and the nodes
+  // below,
+  //     sum coefficient(column, decision) * column >= lower
+  // ("arc e is used" as flow on e >= 1). False when fixing the columns
+  // it doesn't allow is enough.
+  virtual bool decision_row(int /*decision*/, double * /*lower*/) {
+    return false;
+  }
+  // Coefficient of a column already in the problem in a decision's row.
+  // Columns priced below the decision join the row through add_column,
+  // see Pricing::decision_row.
+  virtual double coefficient(const Variable& /*column*/,
+                             int /*decision*/) {
     return 0;
   }
-  virtual double value(Variable& var) {
-    if (var.var_ == NULL) {
-      return 0.0;
-    } else {
-      return SCIPgetVarSol(scip_, var.var_);
-    }
+};
+
+// The node being priced, as a ColumnGenerator sees it.
+class Pricing {
+ public:
+  // Dual value of a kept row in the node's LP. When the LP is infeasible
+  // these are its Farkas multipliers, and a column helps when
+  //     objective_weight() * objective - sum dual(row) * coefficient < 0
+  // holds in both cases (the weight is 0 for an infeasible LP).
+  inline double dual(const Row& row) const;
+  bool farkas() const {
+    return farkas_;
   }
-  virtual bool is_optimal() {
-    return SCIPgetStatus(scip_) == SCIP_STATUS_OPTIMAL;
+  double objective_weight() const {
+    return farkas_ ? 0 : 1;
   }
- private:
-  LPSolution(SCIP *scip) : scip_(scip) {
+  inline double lp_objective() const;
+  // Decisions on the way from the root down to the node.
+  const std::vector<int>& decisions() const {
+    return decisions_;
   }
-  virtual ~LPSolution() {
+  // The row of one of those decisions, invalid when it has none. It takes
+  // duals and columns like a kept row.
+  inline Row decision_row(int decision) const;
+  // A lower bound for the node's LP over every column, not only the ones
+  // in it, when the generator knows one. SCIP may stop pricing early.
+  void set_lower_bound(double bound) {
+    lower_bound_ = bound;
+  }
+  inline Variable add_column(double objective, const Row *rows,
+                             const double *vals, int size);
+ private:
+  inline Pricing(MIPSolver *solver, bool farkas);
+  MIPSolver *solver_;
+  bool farkas_;
+  std::vector<int> decisions_;
+  double lower_bound_;
+  friend Pricer;
+};
+
+// How parallel_solve() spreads the search. threads 0 lets SCIP use every
+// core. emphasis names the setting of each thread, cycled over the
+// threads: default, feasibility, optimality, hardlp, cp or easy.
+// Deterministic runs give the same answer for the same seed and thread
+// count, at some cost in speed.
+struct ParallelSettings {
+  int threads;
+  int seed;
+  bool deterministic;
+  std::vector<std::string> emphasis;
+  ParallelSettings() : threads(0), seed(0), deterministic(false) {
   }
-  SCIP *scip_;
-  friend Handler;
 };
 
 class MIPSolver {
  public:
-  MIPSolver() : constraints_(0) {
+  // SCIP messages also go to log_file, or nowhere when it is NULL.
+  explicit MIPSolver(const char *log_file = "log.txt")
+      : constraints_(0), keep_rows_(false), building_(false),
+        stall_seconds_(0), last_improvement_(0), cancel_(false),
+        lower_bound_(-std::numeric_limits<double>::infinity()),
+        generator_(NULL), priced_(0) {
     SCIPcreate(&scip_);
-    SCIPsetMessagehdlrLogfile(scip_, "log.txt");
-    SCIPprintVersion(scip_, NULL);
+    if (log_file != NULL) {
+      SCIPsetMessagehdlrLogfile(scip_, log_file);
+      SCIPprintVersion(scip_, NULL);
+    } else {
+      SCIPsetMessagehdlrQuiet(scip_, TRUE);
+    }
     SCIPsetEmphasis(scip_, SCIP_PARAMEMPHASIS_OPTIMALITY, FALSE);
     SCIPincludeDefaultPlugins(scip_);
+    SCIPincludeObjEventhdlr(scip_, new Handler(scip_, this), TRUE);
     SCIPcreateProbBasic(scip_, "MIP");
+    builders_.push_back(RowBuilder(this));
   }
+  MIPSolver(const MIPSolver&) = delete;
   ~MIPSolver() {
+    release_decision_rows();
+    for (auto cons : rows_) {
+      SCIPreleaseCons(scip_, &cons);
+    }
     for (auto var : variables_) {
-      SCIPreleaseVar(scip_, &var.var_);
+      SCIPreleaseVar(scip_, &var);
     }
     SCIPfree(&scip_);
   }
   Variable binary_variable(double objective) {
-    return push_var(BinaryVariable(scip_, objective, next_name()));
+    return new_variable(0, 1, objective, SCIP_VARTYPE_BINARY);
   }
   Variable integer_variable(int lower_bound, int upper_bound,
                             double objective) {
-    return push_var(IntegerVariable(
-        scip_, lower_bound, upper_bound, objective, next_name()));
+    return new_variable(
+        lower_bound, upper_bound, objective, SCIP_VARTYPE_INTEGER);
   }
-  Variable push_var(Variable var) {
+  // A binary column with its coefficients in kept rows. Added while
+  // solving, by a ColumnGenerator, it is a priced column, which goes away
+  // with the solve once the model changes again.
+  Variable add_column(double objective, const Row *rows, const double *vals,
+                      int size) {
+    if (SCIPgetStage(scip_) != SCIP_STAGE_SOLVING) {
+      Variable column = binary_variable(objective);
+      // the <= 1 is left out of the LP, so it has no dual to price
+      SCIPchgVarUbLazy(scip_, variables_.back(), 1);
+      for (int i = 0; i < size; i++) {
+        add_to_row(rows[i], column, vals[i]);
+      }
+      return column;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "variable%d", (int) variables_.size());
+    SCIP_VAR *var;
+    SCIPcreateVarBasic(scip_, &var, name, 0, 1, objective,
+                       SCIP_VARTYPE_BINARY);
+    SCIPaddPricedVar(scip_, var, 1);
+    SCIPchgVarUbLazy(scip_, var, 1);
+    for (int i = 0; i < size; i++) {
+      SCIPaddCoefLinear(scip_, transformed_rows_[rows[i].index_], var,
+                        vals[i]);
+    }
     variables_.push_back(var);
-    return var;
+    transformed_.push_back(var);
+    priced_++;
+    return Variable(variables_.size() - 1);
   }
-  std::string next_name() {
-    return std::string("variable") + std::to_string(variables_.size());
+  // Solves by column generation from now on: the generator prices columns
+  // at every node and picks what to branch on. Rows committed afterwards
+  // are kept and modifiable, so columns can join them later. The generator
+  // is not owned, and a reset() turns it off.
+  void generate_columns(ColumnGenerator *generator) {
+    to_problem_stage();
+    if (SCIPfindPricer(scip_, "easyscip") == NULL) {
+      include_plugins();
+    }
+    SCIPactivatePricer(scip_, SCIPfindPricer(scip_, "easyscip"));
+    generator_ = generator;
+    keep_rows_ = true;
   }
   Constraint constraint() {
-    return Constraint(new MIPConstraint(scip_, constraints_++));
+    // builders_[0] is reserved for row(), the others are pooled
+    to_problem_stage();
+    if (free_builders_.empty()) {
+      builders_.push_back(RowBuilder(this));
+      free_builders_.push_back(&builders_.back());
+    }
+    RowBuilder *builder = free_builders_.back();
+    free_builders_.pop_back();
+    return Constraint(builder, &free_builders_);
+  }
+  // Starts a new row in the shared builder, dropping any uncommitted terms.
+  // Only one row can be open at a time.
+  RowBuilder& row() {
+    to_problem_stage();
+    builders_[0].clear();
+    return builders_[0];
+  }
+  Row add_row(const Variable *vars, const double *vals, int size,
+              double lower_bound, double upper_bound) {
+    row().add_variables(vars, vals, size);
+    return builders_[0].commit(lower_bound, upper_bound);
   }
+  Row add_row(const Variable *vars, int size, double val,
+              double lower_bound, double upper_bound) {
+    row().add_variables(vars, size, val);
+    return builders_[0].commit(lower_bound, upper_bound);
+  }
+  // From now on committed rows are kept and can be changed later, which
+  // is needed to grow or shrink a model between solves.
+  void keep_rows(bool keep) {
+    keep_rows_ = keep;
+  }
+  void add_to_row(Row row, const Variable& var, double val) {
+    if (var.index_ >= 0) {
+      to_problem_stage();
+      SCIPaddCoefLinear(scip_, rows_[row.index_], variables_[var.index_], val);
+    }
+  }
+  void set_row_bounds(Row row, double lower_bound, double upper_bound) {
+    to_problem_stage();
+    SCIPchgLhsLinear(scip_, rows_[row.index_], -SCIPinfinity(scip_));
+    SCIPchgRhsLinear(scip_, rows_[row.index_], upper_bound);
+    SCIPchgLhsLinear(scip_, rows_[row.index_], lower_bound);
+  }
+  void set_bounds(const Variable& var, double lower_bound,
+                  double upper_bound) {
+    if (var.index_ >= 0) {
+      to_problem_stage();
+      SCIPchgVarLb(scip_, variables_[var.index_], lower_bound);
+      SCIPchgVarUb(scip_, variables_[var.index_], upper_bound);
+    }
+  }
+  // Hands SCIP a solution to start the next solve from: vars[i] = vals[i]
+  // and every other variable 0. A partial solution leaves the other
+  // variables unknown, and SCIP tries to complete it when solving starts.
+  // Returns whether SCIP stored it.
+  bool add_solution(const Variable *vars, const double *vals, int size,
+                    bool partial = false) {
+    SCIP_SOL *sol;
+    if (partial) {
+      to_problem_stage();
+      SCIPcreatePartialSol(scip_, &sol, NULL);
+    } else {
+      SCIPcreateSol(scip_, &sol, NULL);
+    }
+    for (int i = 0; i < size; i++) {
+      if (vars[i].index_ >= 0) {
+        SCIPsetSolVal(scip_, sol, variables_[vars[i].index_], vals[i]);
+      }
+    }
+    SCIP_Bool stored;
+    SCIPaddSolFree(scip_, &sol, &stored);
+    return stored;
+  }
+  // Drops the problem, with its variables and rows, so the solver can take
+  // another one. Plugins and parameters are kept, but not what belongs to
+  // the last problem: rows are no longer kept (see keep_rows), column
+  // generation is off, the time, gap and stall limits are lifted and the
+  // incumbent callback is dropped.
+  void reset() {
+    for (auto cons : rows_) {
+      SCIPreleaseCons(scip_, &cons);
+    }
+    for (auto var : variables_) {
+      SCIPreleaseVar(scip_, &var);
+    }
+    release_decision_rows();
+    rows_.clear();
+    variables_.clear();
+    constraints_ = 0;
+    keep_rows_ = false;
+    generator_ = NULL;
+    priced_ = 0;
+    transformed_.clear();
+    transformed_rows_.clear();
+    node_decisions_.clear();
+    building_ = false;
+    stats_.clear();
+    SCIPresetParam(scip_, "limits/time");
+    SCIPresetParam(scip_, "limits/gap");
+    stall_seconds_ = 0;
+    on_incumbent_ = nullptr;
+    cancel_ = false;
+    interrupted_.clear();
+    lower_bound_ = -std::numeric_limits<double>::infinity();
+    SCIPfreeProb(scip_);
+    SCIPcreateProbBasic(scip_, "MIP");
+  }
+  // Solving again after the model changed starts over from the original
+  // problem, only the solutions handed with add_solution are kept.
   Solution solve() {
+    auto start = std::chrono::steady_clock::now();
+    end_build(start);
+    SCIPpresolve(scip_);
+    auto presolved = std::chrono::steady_clock::now();
     SCIPsolve(scip_);
-    return Solution(new MIPSolution(scip_, SCIPgetBestSol(scip_)));
+    stats_.presolve_seconds +=
+        std::chrono::duration<double>(presolved - start).count();
+    return solved(presolved);
   }
+  // Solves with several SCIP instances racing on their own threads, as
+  // set by set_parallel. Needs SCIP built with a task interface (TPI),
+  // otherwise SCIP solves on one thread.
   Solution parallel_solve() {
+    auto start = std::chrono::steady_clock::now();
+    end_build(start);
     SCIPsolveConcurrent(scip_);
-    return Solution(new MIPSolution(scip_, SCIPgetBestSol(scip_)));
+    return solved(start);
+  }
+  // Timings and search statistics, as of the last solve. Callers add
+  // their own phases with stats().add_phase.
+  SolveStats& stats() {
+    return stats_;
   }
-  void set_time_limit(int seconds) {
+  // Stops the build clock, when other work runs between building the model
+  // and solving it. Changing the model again starts it over.
+  void end_build() {
+    end_build(std::chrono::steady_clock::now());
+  }
+  // Drops the last solve so the next one starts from scratch, to time or
+  // compare solves of the same model.
+  void restart() {
+    to_problem_stage();
+  }
+  void set_parallel(const ParallelSettings& settings) {
+    static const char *names[][2] = {
+      {"default", "scip-default"}, {"feasibility", "scip-feas"},
+      {"optimality", "scip-opti"}, {"hardlp", "scip-hardlp"},
+      {"cp", "scip-cpsolver"}, {"easy", "scip-easycip"}};
+    const int types = sizeof(names) / sizeof(names[0]);
+    SCIPsetIntParam(scip_, "parallel/maxnthreads", settings.threads);
+    SCIPsetIntParam(scip_, "parallel/mode", settings.deterministic ? 1 : 0);
+    SCIPsetIntParam(scip_, "randomization/randomseedshift", settings.seed);
+    SCIPsetIntParam(scip_, "concurrent/initseed", settings.seed);
+    // SCIP shares the threads between solver types by preference, so the
+    // emphasis list becomes how often each type appears in it (an empty
+    // list keeps SCIP's own mix)
+    for (int type = 0; type < types && !settings.emphasis.empty(); type++) {
+      int count = 0;
+      for (const std::string& emphasis : settings.emphasis) {
+        count += emphasis == names[type][0];
+      }
+      char param[64];
+      snprintf(param, sizeof(param), "concurrent/%s/prefprio", names[type][1]);
+      SCIPsetRealParam(scip_, param,
+                       (double) count / settings.emphasis.size());
+    }
+  }
+  // Loads SCIP parameters from a .set file.
+  bool read_settings(const std::string& filename) {
+    return SCIPreadParams(scip_, filename.c_str()) == SCIP_OKAY;
+  }
+  void set_time_limit(double seconds) {
     SCIPsetRealParam(scip_, "limits/time", seconds);
   }
+  // Stops once the relative gap between the best solution and the dual
+  // bound is at most gap (0.01 is 1%).
+  void set_gap_limit(double gap) {
+    SCIPsetRealParam(scip_, "limits/gap", gap);
+  }
+  // Stops once seconds go by without a better solution, as long as there
+  // is one (0 never stops).
+  void set_stall_limit(double seconds) {
+    stall_seconds_ = seconds;
+  }
+  // A lower bound on the objective found outside SCIP (a relaxation the
+  // caller solved), handed to the root node of the next solve so the gap
+  // closes sooner. It only holds for the model as it is, so that solve
+  // drops it.
+  void set_lower_bound(double bound) {
+    lower_bound_ = bound;
+  }
+  // Called on the solving thread with every improving solution, to use a
+  // good enough answer before the solve ends. Concurrent solves only
+  // report the solutions that reach this solver.
+  void on_incumbent(std::function<void(const Incumbent&)> callback) {
+    on_incumbent_ = callback;
+  }
+  // Stops the running solve as soon as SCIP allows, keeping the best
+  // solution so far (status "cancelled"). Safe from other threads and from
+  // signal handlers; with no solve running it stops the next one.
+  void cancel() {
+    cancel_ = true;
+  }
   int count_solutions() {
     SCIPcount(scip_);
     SCIP_Bool valid;
@@ -278,9 +735,472 @@ class MIPSolver {
     SCIPwriteOrigProblem(scip_, filename.c_str(), NULL, 0);
   }
  private:
+  // SCIP only accepts changes to the original problem, so the previous
+  // solve (if any) is thrown away before the model is touched.
+  void to_problem_stage() {
+    if (!building_) {
+      building_ = true;
+      build_start_ = std::chrono::steady_clock::now();
+    }
+    if (SCIPgetStage(scip_) > SCIP_STAGE_PROBLEM) {
+      for (; priced_ > 0; priced_--) {
+        SCIPreleaseVar(scip_, &variables_.back());
+        variables_.pop_back();
+      }
+      release_decision_rows();
+      transformed_.clear();
+      transformed_rows_.clear();
+      node_decisions_.clear();
+      SCIPfreeTransform(scip_);
+    }
+  }
+  // Decision rows are the transformed rows past the kept ones, created by
+  // the Brancher and held until the solve goes away.
+  void release_decision_rows() {
+    for (int i = rows_.size(); i < (int) transformed_rows_.size(); i++) {
+      SCIPreleaseCons(scip_, &transformed_rows_[i]);
+    }
+    transformed_rows_.resize(std::min(transformed_rows_.size(), rows_.size()));
+    decision_rows_.clear();
+  }
+  Solution solved(std::chrono::steady_clock::time_point start) {
+    static const struct {
+      SCIP_STATUS status;
+      const char *name;
+    } names[] = {
+      {SCIP_STATUS_OPTIMAL, "optimal"},
+      {SCIP_STATUS_INFEASIBLE, "infeasible"},
+      {SCIP_STATUS_TIMELIMIT, "timelimit"},
+      {SCIP_STATUS_GAPLIMIT, "gaplimit"},
+      {SCIP_STATUS_STALLNODELIMIT, "stallnodelimit"},
+      {SCIP_STATUS_USERINTERRUPT, "userinterrupt"}};
+    stats_.solve_seconds += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    stats_.solves++;
+    stats_.nodes += SCIPgetNNodes(scip_);
+    stats_.lp_iterations += SCIPgetNLPIterations(scip_);
+    stats_.primal_bound = SCIPgetPrimalbound(scip_);
+    stats_.dual_bound = SCIPgetDualbound(scip_);
+    stats_.gap = SCIPgetGap(scip_);
+    stats_.status = "other";
+    for (auto& name : names) {
+      if (SCIPgetStatus(scip_) == name.status) {
+        stats_.status = name.name;
+      }
+    }
+    if (SCIPgetStatus(scip_) == SCIP_STATUS_USERINTERRUPT &&
+        !interrupted_.empty()) {
+      stats_.status = interrupted_;
+    }
+    interrupted_.clear();
+    cancel_ = false;
+    lower_bound_ = -std::numeric_limits<double>::infinity();
+    return Solution(scip_, SCIPgetBestSol(scip_), &variables_, false,
+                    &stats_);
+  }
+  inline void include_plugins();
+  // Decisions of the current node and its ancestors, root first.
+  std::vector<int> decisions() {
+    std::vector<int> decisions;
+    for (SCIP_NODE *node = SCIPgetCurrentNode(scip_); node != NULL;
+         node = SCIPnodeGetParent(node)) {
+      auto decision = node_decisions_.find(SCIPnodeGetNumber(node));
+      if (decision != node_decisions_.end()) {
+        decisions.push_back(decision->second);
+      }
+    }
+    std::reverse(decisions.begin(), decisions.end());
+    return decisions;
+  }
+  void end_build(std::chrono::steady_clock::time_point now) {
+    if (building_) {
+      stats_.build_seconds +=
+          std::chrono::duration<double>(now - build_start_).count();
+      building_ = false;
+    }
+  }
+  Variable new_variable(double lower_bound, double upper_bound,
+                        double objective, SCIP_VARTYPE type) {
+    to_problem_stage();
+    char name[32];
+    snprintf(name, sizeof(name), "variable%d", (int) variables_.size());
+    SCIP_VAR *var;
+    SCIPcreateVarBasic(
+        scip_, &var, name, lower_bound, upper_bound, objective, type);
+    SCIPaddVar(scip_, var);
+    variables_.push_back(var);
+    return Variable(variables_.size() - 1);
+  }
   int constraints_;
+  bool keep_rows_;
+  bool building_;  // the model changed since the last solve, from build_start_
+  std::chrono::steady_clock::time_point build_start_;
   SCIP *scip_;
-  std::vector<Variable> variables_;
+  std::vector<SCIP_VAR*> variables_;
+  std::vector<SCIP_CONS*> rows_;
+  // deque keeps the builders in place as the pool grows
+  std::deque<RowBuilder> builders_;
+  std::vector<RowBuilder*> free_builders_;
+  SolveStats stats_;
+  std::function<void(const Incumbent&)> on_incumbent_;
+  double stall_seconds_;
+  double last_improvement_;  // solving time of the last better solution
+  std::atomic<bool> cancel_;
+  std::string interrupted_;  // why the handler stopped the solve, if it did
+  double lower_bound_;  // see set_lower_bound, -infinity when there is none
+  // column generation, only while solving: the variables and kept rows in
+  // SCIP's transformed problem, by index, the decision of every child node
+  // by node number and the transformed row of the decisions that have one.
+  // Priced columns are the last priced_ variables.
+  ColumnGenerator *generator_;
+  int priced_;
+  std::vector<SCIP_VAR*> transformed_;
+  std::vector<SCIP_CONS*> transformed_rows_;
+  std::map<SCIP_Longint, int> node_decisions_;
+  std::map<int, int> decision_rows_;
+  friend RowBuilder;
+  friend Handler;
+  friend Pricing;
+  friend Pricer;
+  friend Brancher;
+  friend Decisions;
+};
+
+SCIP_DECL_EVENTINITSOL(Handler::scip_initsol) {
+  solver_->last_improvement_ = SCIPgetSolvingTime(scip);
+  return SCIPcatchEvent(scip, EVENTS, eventhdlr, NULL, NULL);
+}
+
+SCIP_DECL_EVENTEXEC(Handler::scip_exec) {
+  // the root's bound is every node's, children start from their parent's
+  if (SCIPgetDepth(scip) == 0 &&
+      solver_->lower_bound_ > -std::numeric_limits<double>::infinity()) {
+    SCIPupdateLocalLowerbound(scip,
+                              SCIPtransformObj(scip, solver_->lower_bound_));
+  }
+  SolveStats& stats = solver_->stats_;
+  double now = SCIPgetSolvingTime(scip);
+  double primal = SCIPgetPrimalbound(scip);
+  double dual = SCIPgetDualbound(scip);
+  std::vector<SolveStats::Bounds>& history = stats.history;
+  int solve = stats.solves + 1;
+  if (history.empty() || history.back().solve != solve ||
+      history.back().primal != primal || history.back().dual != dual) {
+    SolveStats::Bounds bounds = {solve, now, primal, dual};
+    history.push_back(bounds);
+  }
+  if (SCIPeventGetType(event) & SCIP_EVENTTYPE_BESTSOLFOUND) {
+    solver_->last_improvement_ = now;
+    if (solver_->on_incumbent_) {
+      Solution solution(scip, SCIPgetBestSol(scip), &solver_->variables_,
+                        false, NULL);
+      Incumbent incumbent = {solution, now, primal, dual, SCIPgetGap(scip)};
+      solver_->on_incumbent_(incumbent);
+    }
+  }
+  if (!solver_->interrupted_.empty()) {
+    return SCIP_OKAY;
+  }
+  if (solver_->cancel_) {
+    solver_->interrupted_ = "cancelled";
+  } else if (solver_->stall_seconds_ > 0 && SCIPgetNSols(scip) > 0 &&
+             now - solver_->last_improvement_ >= solver_->stall_seconds_) {
+    solver_->interrupted_ = "stalled";
+  } else {
+    return SCIP_OKAY;
+  }
+  return SCIPinterruptSolve(scip);
+}
+
+// The SCIP plugins behind MIPSolver::generate_columns, they hand the work
+// to the solver's ColumnGenerator.
+class Pricer : public scip::ObjPricer {
+ public:
+  Pricer(SCIP *scip, MIPSolver *solver)
+      : scip::ObjPricer(scip, "easyscip", "easyscip column generation", 0,
+                        TRUE),
+        solver_(solver) {
+  }
+  virtual SCIP_DECL_PRICERINITSOL(scip_initsol) {
+    std::vector<SCIP_VAR*>& vars = solver_->variables_;
+    std::vector<SCIP_CONS*>& rows = solver_->rows_;
+    solver_->transformed_.resize(vars.size());
+    SCIPgetTransformedVars(scip, vars.size(), vars.data(),
+                           solver_->transformed_.data());
+    solver_->transformed_rows_.resize(rows.size());
+    for (int i = 0; i < (int) rows.size(); i++) {
+      SCIPgetTransformedCons(scip, rows[i], &solver_->transformed_rows_[i]);
+    }
+    return SCIP_OKAY;
+  }
+  virtual SCIP_DECL_PRICERREDCOST(scip_redcost) {
+    Pricing pricing(solver_, false);
+    solver_->generator_->price(pricing);
+    if (pricing.lower_bound_ > -SCIPinfinity(scip)) {
+      *lowerbound = pricing.lower_bound_;
+    }
+    *result = SCIP_SUCCESS;
+    return SCIP_OKAY;
+  }
+  virtual SCIP_DECL_PRICERFARKAS(scip_farkas) {
+    Pricing pricing(solver_, true);
+    solver_->generator_->price(pricing);
+    *result = SCIP_SUCCESS;
+    return SCIP_OKAY;
+  }
+ private:
+  MIPSolver *solver_;
+};
+
+// Runs before SCIP's own branching rules, which then only see the LPs the
+// generator could not split.
+class Brancher : public scip::ObjBranchrule {
+ public:
+  Brancher(SCIP *scip, MIPSolver *solver)
+      : scip::ObjBranchrule(scip, "easyscip", "easyscip decisions", 1000000,
+                            -1, 1),
+        solver_(solver) {
+  }
+  virtual SCIP_DECL_BRANCHEXECLP(scip_execlp) {
+    *result = SCIP_DIDNOTRUN;
+    int decision[2];
+    ColumnGenerator *generator = solver_->generator_;
+    Solution lp(scip, NULL, &solver_->variables_, true, NULL);
+    if (generator == NULL) {
+      return SCIP_OKAY;
+    }
+    if (!generator->branch(lp, solver_->decisions(), &decision[0],
+                           &decision[1])) {
+      if (SCIPgetNLPBranchCands(scip) == 0) {
+        return SCIP_OKAY;
+      }
+      // branching on a priced column does not hold, see ColumnGenerator
+      SCIPerrorMessage("easyscip: fractional columns but no decision to "
+                       "branch on\n");
+      return SCIP_ERROR;
+    }
+    for (int side = 0; side < 2; side++) {
+      SCIP_NODE *child;
+      SCIPcreateChild(scip, &child, 0, SCIPgetLocalTransEstimate(scip));
+      solver_->node_decisions_[SCIPnodeGetNumber(child)] = decision[side];
+      double lower;
+      if (generator->decision_row(decision[side], &lower)) {
+        add_decision_row(scip, child, decision[side], lower);
+      }
+    }
+    *result = SCIP_BRANCHED;
+    return SCIP_OKAY;
+  }
+ private:
+  // A local, modifiable row over the columns in the problem so far, which
+  // pricing extends below the child.
+  void add_decision_row(SCIP *scip, SCIP_NODE *child, int decision,
+                        double lower) {
+    std::vector<SCIP_VAR*>& vars = solver_->transformed_;
+    std::vector<SCIP_CONS*>& rows = solver_->transformed_rows_;
+    char name[32];
+    snprintf(name, sizeof(name), "decision%d", decision);
+    SCIP_CONS *cons;
+    SCIPcreateConsLinear(
+        scip, &cons, name, 0, NULL, NULL, lower, SCIPinfinity(scip),
+        TRUE,   // initial
+        TRUE,   // separate
+        TRUE,   // enforce
+        TRUE,   // check
+        TRUE,   // propagate
+        TRUE,   // local
+        TRUE,   // modifiable
+        FALSE,  // dynamic
+        FALSE,  // removable
+        TRUE);  // stickatnode
+    for (int i = 0; i < (int) vars.size(); i++) {
+      double val = solver_->generator_->coefficient(Variable(i), decision);
+      if (val != 0) {
+        SCIPaddCoefLinear(scip, cons, vars[i], val);
+      }
+    }
+    SCIPaddConsNode(scip, child, cons, NULL);
+    solver_->decision_rows_[decision] = rows.size();
+    rows.push_back(cons);
+  }
+  MIPSolver *solver_;
+};
+
+// Fixes to 0, at every node, the columns its decisions rule out. Columns
+// priced in another part of the tree are caught too, as this runs again
+// whenever a node is entered.
+class Decisions : public scip::ObjProp {
+ public:
+  Decisions(SCIP *scip, MIPSolver *solver)
+      : scip::ObjProp(scip, "easyscip", "easyscip decisions", 1000000, 1,
+                      FALSE, SCIP_PROPTIMING_BEFORELP, 0, 0,
+                      SCIP_PRESOLTIMING_NONE),
+        solver_(solver) {
+  }
+  virtual SCIP_DECL_PROPEXEC(scip_exec) {
+    *result = SCIP_DIDNOTRUN;
+    if (solver_->generator_ == NULL) {
+      return SCIP_OKAY;
+    }
+    std::vector<int> decisions = solver_->decisions();
+    *result = SCIP_DIDNOTFIND;
+    if (decisions.empty()) {
+      return SCIP_OKAY;
+    }
+    std::vector<SCIP_VAR*>& vars = solver_->transformed_;
+    for (int i = 0; i < (int) vars.size(); i++) {
+      if (SCIPvarGetUbLocal(vars[i]) < 0.5 ||
+          solver_->generator_->allowed(Variable(i), decisions)) {
+        continue;
+      }
+      if (SCIPvarGetLbLocal(vars[i]) > 0.5) {
+        *result = SCIP_CUTOFF;
+        return SCIP_OKAY;
+      }
+      SCIPchgVarUb(scip, vars[i], 0);
+      *result = SCIP_REDUCEDDOM;
+    }
+    return SCIP_OKAY;
+  }
+ private:
+  MIPSolver *solver_;
+};
+
+void MIPSolver::include_plugins() {
+  SCIPincludeObjPricer(scip_, new Pricer(scip_, this), TRUE);
+  SCIPincludeObjBranchrule(scip_, new Brancher(scip_, this), TRUE);
+  SCIPincludeObjProp(scip_, new Decisions(scip_, this), TRUE);
+}
+
+Pricing::Pricing(MIPSolver *solver, bool farkas)
+    : solver_(solver), farkas_(farkas), decisions_(solver->decisions()),
+      lower_bound_(-SCIPinfinity(solver->scip_)) {
+}
+
+double Pricing::dual(const Row& row) const {
+  SCIP_CONS *cons = solver_->transformed_rows_[row.index_];
+  return farkas_ ? SCIPgetDualfarkasLinear(solver_->scip_, cons) :
+      SCIPgetDualsolLinear(solver_->scip_, cons);
+}
+
+Row Pricing::decision_row(int decision) const {
+  auto row = solver_->decision_rows_.find(decision);
+  return row == solver_->decision_rows_.end() ? Row() : Row(row->second);
+}
+
+double Pricing::lp_objective() const {
+  return SCIPgetLPObjval(solver_->scip_);
+}
+
+Variable Pricing::add_column(double objective, const Row *rows,
+                             const double *vals, int size) {
+  return solver_->add_column(objective, rows, vals, size);
+}
+
+void RowBuilder::add_variable(const Variable& var, double val) {
+  if (var.index_ >= 0) {
+    vars_.push_back(solver_->variables_[var.index_]);
+    vals_.push_back(val);
+  }
+}
+
+Row RowBuilder::commit(double lower_bound, double upper_bound) {
+  if (vars_.empty() && !solver_->keep_rows_) {
+    return Row();
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "constraint%d", solver_->constraints_++);
+  SCIP *scip = solver_->scip_;
+  SCIP_CONS *cons;
+  SCIPcreateConsLinear(
+      scip, &cons, name, vars_.size(), vars_.data(), vals_.data(),
+      lower_bound, upper_bound,
+      TRUE,   // initial
+      TRUE,   // separate
+      TRUE,   // enforce
+      TRUE,   // check
+      TRUE,   // propagate
+      FALSE,  // local
+      solver_->generator_ != NULL,  // modifiable
+      FALSE,  // dynamic
+      FALSE,  // removable
+      FALSE); // stickatnode
+  SCIPaddCons(scip, cons);
+  clear();
+  if (!solver_->keep_rows_) {
+    SCIPreleaseCons(scip, &cons);
+    return Row();
+  }
+  solver_->rows_.push_back(cons);
+  return Row(solver_->rows_.size() - 1);
+}
+
+// Keeps solvers with their plugins already loaded, so a long running
+// service does not pay SCIP's setup for every problem. A leased solver is
+// reset and goes back to the pool when the lease dies. Thread safe.
+class SolverPool {
+ public:
+  class Lease {
+   public:
+    MIPSolver& operator*() const {
+      return *solver_;
+    }
+    MIPSolver *operator->() const {
+      return solver_.get();
+    }
+    Lease(Lease&& other)
+        : pool_(other.pool_), solver_(std::move(other.solver_)) {
+    }
+    ~Lease() {
+      if (solver_) {
+        pool_->release(std::move(solver_));
+      }
+    }
+   private:
+    Lease(SolverPool *pool, std::unique_ptr<MIPSolver> solver)
+        : pool_(pool), solver_(std::move(solver)) {
+    }
+    SolverPool *pool_;
+    std::unique_ptr<MIPSolver> solver_;
+    friend SolverPool;
+  };
+  // log_file as in MIPSolver, every solver of the pool shares it.
+  explicit SolverPool(const char *log_file = NULL)
+      : log_file_(log_file == NULL ? "" : log_file),
+        quiet_(log_file == NULL) {
+  }
+  // Creates solvers ahead of time, up to count idle ones.
+  void prewarm(int count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while ((int) idle_.size() < count) {
+      idle_.push_back(create());
+    }
+  }
+  Lease acquire() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!idle_.empty()) {
+        std::unique_ptr<MIPSolver> solver = std::move(idle_.back());
+        idle_.pop_back();
+        return Lease(this, std::move(solver));
+      }
+    }
+    return Lease(this, create());
+  }
+ private:
+  std::unique_ptr<MIPSolver> create() {
+    return std::unique_ptr<MIPSolver>(
+        new MIPSolver(quiet_ ? NULL : log_file_.c_str()));
+  }
+  void release(std::unique_ptr<MIPSolver> solver) {
+    solver->reset();
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(std::move(solver));
+  }
+  std::string log_file_;
+  bool quiet_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<MIPSolver>> idle_;
 };
 
 }  // namespace easyscip
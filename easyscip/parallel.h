@@ -0,0 +1,40 @@
+// Runs independent tasks on a few threads.
+// Part of EasySCIP, see easyscip.h.
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace easyscip {
+
+// Number of threads to use when the caller has no preference.
+inline int default_threads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Calls task(worker, i) for every i in [0, size) on up to `threads`
+// threads. Idle workers take the next task from a shared counter, so
+// slow tasks do not hold back the others. Each worker runs on its own
+// thread, so it can keep per-worker state (a MIPSolver for instance)
+// indexed by `worker`.
+template <typename Task>
+void parallel_for(int size, int threads, Task task) {
+  threads = std::max(1, std::min(threads, size));
+  std::atomic<int> next(0);
+  auto work = [&](int worker) {
+    for (int i = next++; i < size; i = next++) {
+      task(worker, i);
+    }
+  };
+  std::vector<std::thread> pool;
+  for (int worker = 1; worker < threads; worker++) {
+    pool.push_back(std::thread(work, worker));
+  }
+  work(0);
+  for (auto& thread : pool) {
+    thread.join();
+  }
+}
+
+}  // namespace easyscip
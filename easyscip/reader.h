@@ -0,0 +1,241 @@
+// Reads whitespace-separated numbers and words from a file or a stream.
+// Part of EasySCIP, see easyscip.h.
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace easyscip {
+
+// Regular files are mapped in memory, anything else (pipes, terminals) is
+// read in big blocks, and tokens are parsed in place, so reading allocates
+// nothing per token. Errors don't throw: the first one is kept, with its
+// line, every later read returns 0, and the caller checks ok() once done.
+class Reader {
+ public:
+  // Reads from an open descriptor, stdin by default. The descriptor is not
+  // closed.
+  explicit Reader(int fd = 0)
+      : fd_(fd), owned_(false), eof_(true), line_(1), mapped_(NULL),
+        pos_(NULL), end_(NULL), last_(NULL) {
+    start();
+  }
+  explicit Reader(const std::string& path)
+      : fd_(open(path.c_str(), O_RDONLY)), owned_(true), eof_(true), line_(1),
+        mapped_(NULL), pos_(NULL), end_(NULL), last_(NULL) {
+    if (fd_ < 0) {
+      error_ = "cannot open " + path;
+      return;
+    }
+    start();
+  }
+  Reader(const Reader&) = delete;
+  Reader& operator=(const Reader&) = delete;
+  ~Reader() {
+    if (mapped_ != NULL) {
+      munmap(mapped_, mapped_size_);
+    }
+    if (owned_ && fd_ >= 0) {
+      close(fd_);
+    }
+  }
+  bool ok() const {
+    return error_.empty();
+  }
+  // The first error, as "line <n>: expected <what>, found <token>".
+  const std::string& error() const {
+    return error_;
+  }
+  // True when only whitespace is left.
+  bool at_end() {
+    return !skip_space();
+  }
+  // Next token as an int, `what` names it in the error message.
+  int integer(const char *what) {
+    const char *begin, *end;
+    if (!token(&begin, &end, what)) {
+      return 0;
+    }
+    const char *p = begin;
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') {
+      p++;
+    }
+    long value = 0;
+    for (; p < end && *p >= '0' && *p <= '9' && value <= 1L << 31; p++) {
+      value = value * 10 + (*p - '0');
+    }
+    if (p == begin || !(p[-1] >= '0' && p[-1] <= '9') || p != end ||
+        value > (negative ? 1L << 31 : (1L << 31) - 1)) {
+      fail(what, begin, end);
+      return 0;
+    }
+    return negative ? -value : value;
+  }
+  // Next token as a double. C++11 has no from_chars, so the token is copied
+  // to a small buffer on the stack, where strtod can find its end.
+  double number(const char *what) {
+    const char *begin, *end;
+    if (!token(&begin, &end, what)) {
+      return 0;
+    }
+    char text[64];
+    char *stop;
+    if (end - begin >= (long) sizeof(text)) {
+      fail(what, begin, end);
+      return 0;
+    }
+    memcpy(text, begin, end - begin);
+    text[end - begin] = '\0';
+    double value = strtod(text, &stop);
+    if (stop != text + (end - begin)) {
+      fail(what, begin, end);
+      return 0;
+    }
+    return value;
+  }
+  // Next token as [*begin, *end), only valid until the next read.
+  bool word(const char **begin, const char **end, const char *what) {
+    return token(begin, end, what);
+  }
+  // Records an error about the token just read, for checks the reader
+  // can't do itself (a row of the wrong length for instance).
+  void reject(const char *what) {
+    fail(what, last_, pos_);
+  }
+  // Rest of the current line, without the newline. False at the end of the
+  // input.
+  bool line(std::string *text) {
+    if (!ok() || (pos_ == end_ && !refill(pos_))) {
+      return false;
+    }
+    text->clear();
+    for (;;) {
+      const char *newline = static_cast<const char*>(
+          memchr(pos_, '\n', end_ - pos_));
+      if (newline != NULL) {
+        text->append(pos_, newline);
+        pos_ = newline + 1;
+        line_++;
+        return true;
+      }
+      text->append(pos_, end_);
+      pos_ = end_;
+      if (!refill(pos_)) {
+        return true;
+      }
+    }
+  }
+
+ private:
+  static const size_t BLOCK = 1 << 20;
+  static bool space(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+  }
+  void start() {
+    struct stat info;
+    if (fstat(fd_, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+      void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+      if (data != MAP_FAILED) {
+        mapped_ = static_cast<char*>(data);
+        mapped_size_ = info.st_size;
+        pos_ = mapped_;
+        end_ = mapped_ + mapped_size_;
+        return;
+      }
+    }
+    eof_ = false;
+    buffer_.resize(BLOCK);
+    pos_ = end_ = buffer_.data();
+  }
+  // Reads the next block, keeping [keep, end) at the front of the buffer
+  // (and growing it when that is all there is). False when nothing came.
+  bool refill(const char *&keep) {
+    if (eof_) {
+      return false;
+    }
+    size_t kept = end_ - keep;
+    memmove(buffer_.data(), keep, kept);
+    if (kept == buffer_.size()) {
+      buffer_.resize(2 * buffer_.size());
+    }
+    ssize_t count;
+    do {
+      count = read(fd_, buffer_.data() + kept, buffer_.size() - kept);
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0) {
+      eof_ = true;
+    }
+    keep = buffer_.data();
+    pos_ = keep;
+    end_ = keep + kept + (count > 0 ? count : 0);
+    return count > 0;
+  }
+  bool skip_space() {
+    for (;;) {
+      for (; pos_ < end_ && space(*pos_); pos_++) {
+        line_ += *pos_ == '\n';
+      }
+      if (pos_ < end_) {
+        return true;
+      }
+      if (!refill(pos_)) {
+        return false;
+      }
+    }
+  }
+  bool token(const char **begin, const char **end, const char *what) {
+    if (!ok()) {
+      return false;
+    }
+    if (!skip_space()) {
+      fail(what, NULL, NULL);
+      return false;
+    }
+    const char *first = pos_;
+    const char *p = pos_;
+    for (;;) {
+      for (; p < end_ && !space(*p); p++) {
+      }
+      if (p < end_) {
+        break;
+      }
+      size_t length = p - first;
+      if (!refill(first)) {
+        p = end_;
+        break;
+      }
+      p = first + length;
+    }
+    *begin = last_ = first;
+    *end = p;
+    pos_ = p;
+    return true;
+  }
+  void fail(const char *what, const char *begin, const char *end) {
+    if (ok()) {
+      error_ = "line " + std::to_string(line_) + ": expected " + what +
+          ", found " + (begin == NULL ? "end of input" :
+          "'" + std::string(begin, end) + "'");
+    }
+  }
+
+  int fd_;
+  bool owned_;
+  bool eof_;
+  int line_;
+  char *mapped_;
+  size_t mapped_size_;
+  std::vector<char> buffer_;
+  const char *pos_, *end_;
+  const char *last_;  // start of the last token
+  std::string error_;
+};
+
+}  // namespace easyscip